@@ -0,0 +1,102 @@
+/*
+ * This file is part of librestd.
+ *
+ * Copyleft of Simone Margaritelli aka evilsocket <evilsocket@protonmail.com>
+ *
+ * librestd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * librestd is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with librestd.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <restd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <functional>
+
+// Cost of serializing a response into a reused buffer, as workers do.
+static void measure( const char *name, size_t iterations, const std::function<size_t( std::string& )>& serialize ) {
+  std::string out;
+  size_t      bytes = 0;
+
+  out.reserve( 64 * 1024 );
+  // warm up the buffer and the caches.
+  for( size_t i = 0; i < iterations / 10; ++i ) {
+    out.clear();
+    serialize( out );
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  for( size_t i = 0; i < iterations; ++i ) {
+    out.clear();
+    serialize( out );
+    bytes += out.size();
+  }
+  double elapsed = std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+
+  printf( "%-28s %10.1f ns/response %10.1f MB/s  (%lu bytes)\n", name, elapsed * 1e9 / iterations, bytes / elapsed / 1e6, out.size() );
+}
+
+int main() {
+  const size_t iterations = 200000;
+
+  restd::http_response text;
+  text.text( "Hello World!" );
+  text.headers["Cache-Control"] = "no-cache";
+
+  nlohmann::json small = { { "message", "Hello World!" }, { "id", 1234 }, { "ok", true } };
+  nlohmann::json large = nlohmann::json::array();
+  for( int i = 0; i < 100; ++i ) {
+    large.push_back( { { "id", i }, { "name", "item " + std::to_string(i) }, { "score", i * 1.5 }, { "tags", { "a", "b", "c" } } } );
+  }
+
+  restd::http_response small_json, large_json;
+  small_json.json( small );
+  large_json.json( large );
+
+  measure( "text", iterations, [&]( std::string& out ) {
+    return text.serialize( out );
+  });
+
+  measure( "small json", iterations, [&]( std::string& out ) {
+    return small_json.serialize( out );
+  });
+
+  // what serializing JSON cost before json_writer: dump() then a string body.
+  measure( "small json, dump()", iterations, [&]( std::string& out ) {
+    restd::http_response resp;
+    resp.json( small.dump() );
+    return resp.serialize( out );
+  });
+
+  measure( "large json", iterations / 10, [&]( std::string& out ) {
+    return large_json.serialize( out );
+  });
+
+  measure( "large json, dump()", iterations / 10, [&]( std::string& out ) {
+    restd::http_response resp;
+    resp.json( large.dump() );
+    return resp.serialize( out );
+  });
+
+  measure( "streamed json", iterations, [&]( std::string& out ) {
+    restd::http_response resp;
+    resp.stream_json( []( restd::json_writer& w ) {
+      w.begin_object();
+      w.key( "message" );
+      w.value( "Hello World!" );
+      w.end_object();
+    });
+    return resp.serialize( out );
+  });
+
+  return 0;
+}
@@ -0,0 +1,112 @@
+/*
+ * This file is part of librestd.
+ *
+ * Copyleft of Simone Margaritelli aka evilsocket <evilsocket@protonmail.com>
+ *
+ * librestd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * librestd is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with librestd.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <work_queue.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include <vector>
+#include <list>
+#include <mutex>
+#include <condition_variable>
+
+// The queue work_queue replaced: a list behind a mutex.
+template <typename T>
+class mutex_queue
+{
+  private:
+
+    std::list<T>            _queue;
+    std::mutex              _mutex;
+    std::condition_variable _avail;
+
+  public:
+
+    void add( T item ) {
+      std::unique_lock<std::mutex> lock(_mutex);
+
+      _queue.push_back(item);
+      _avail.notify_one();
+    }
+
+    T get() {
+      std::unique_lock<std::mutex> lock(_mutex);
+
+      while( _queue.size() == 0 ) {
+        _avail.wait(lock);
+      }
+
+      T item = _queue.front();
+      _queue.pop_front();
+
+      return item;
+    }
+};
+
+// Items per second moving from producers to consumers, each consumer
+// stops at the first 0 it gets.
+template <typename Q>
+static double measure( size_t producers, size_t consumers, size_t items ) {
+  Q                        queue;
+  std::vector<std::thread> threads;
+  size_t                   per_producer = items / producers;
+
+  auto start = std::chrono::steady_clock::now();
+
+  for( size_t i = 0; i < consumers; ++i ) {
+    threads.emplace_back( [&queue]() {
+      while( queue.get() != 0 ) {}
+    });
+  }
+  for( size_t i = 0; i < producers; ++i ) {
+    threads.emplace_back( [&queue, per_producer]() {
+      for( size_t n = 1; n <= per_producer; ++n ) {
+        queue.add( n );
+      }
+    });
+  }
+  for( size_t i = consumers; i < threads.size(); ++i ) {
+    threads[i].join();
+  }
+  for( size_t i = 0; i < consumers; ++i ) {
+    queue.add( 0 );
+  }
+  for( size_t i = 0; i < consumers; ++i ) {
+    threads[i].join();
+  }
+
+  double elapsed = std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+  return per_producer * producers / elapsed;
+}
+
+int main() {
+  const size_t items = 2000000;
+  const size_t counts[][2] = { { 1, 1 }, { 1, 4 }, { 4, 1 }, { 2, 2 }, { 4, 4 }, { 8, 8 } };
+
+  printf( "%-22s %14s %14s\n", "producers/consumers", "mutex list", "work_queue" );
+
+  for( auto& count : counts ) {
+    double old_rate = measure<mutex_queue<size_t>>( count[0], count[1], items ),
+           new_rate = measure<restd::work_queue<size_t>>( count[0], count[1], items );
+
+    printf( "%10lu / %-9lu %9.2f Mop/s %9.2f Mop/s  (x%.1f)\n", count[0], count[1], old_rate / 1e6, new_rate / 1e6, new_rate / old_rate );
+  }
+
+  return 0;
+}
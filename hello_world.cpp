@@ -20,6 +20,9 @@
 #include <thread>
 #include <sstream>
 #include <ctime>
+#include <chrono>
+#include <atomic>
+#include <cstdio>
 
 #include <restd.h>
 
@@ -35,6 +38,11 @@ class hello_world : public restd::http_controller {
       ss << "<a href='/hello'>Hello Route</a><br>";
       ss << "<a href='/json'>JSON Route</a><br>";
       ss << "<a href='/named/e4d909c290d0fb1ca068ffaddf22cbd0/i_can_be_empty'>Named Parameters Route</a><br>";
+      ss << "<a href='/typed/42/123e4567-e89b-12d3-a456-426655440000'>Typed Parameters Route</a><br>";
+      ss << "<a href='/ping'>Lambda Route</a><br>";
+      ss << "<a href='/api/json'>Middleware Route</a><br>";
+      ss << "<a href='/report'>Slow Route</a><br>";
+      ss << "<a href='/count?to=1000'>Streaming Route</a><br>";
       ss << "<a href='/form'>Form Route</a><br>";
       ss << "<a href='/debug'>Debug Route</a><br>";
 
@@ -65,18 +73,58 @@ class hello_world : public restd::http_controller {
        }
      };
 
-     resp.json( j.dump(2) );
+     resp.json( std::move(j) );
    }
 
    // POST /jecho
    void jecho( restd::http_request& req, restd::http_response& resp ) {
      if( req.is_json() ) {
-      resp.json( req.json.dump(2) );
+      resp.json( req.json );
      } else {
       resp.text( "Wrong Content-Type dude!", restd::http_response::HTTP_STATUS_BAD_REQUEST );
      }
    }
 
+   // GET /typed/:id<int>/:tok<uuid>
+   void typed( restd::http_request& req, restd::http_response& resp ) {
+     int64_t          id   = req.param<int64_t>("id");
+     std::string_view tok  = req.param<std::string_view>("tok");
+     int64_t          page = req.param<int64_t>("page", 1);
+
+     // no json object at all, just write it out.
+     resp.stream_json( [=]( restd::json_writer& w ) {
+       w.begin_object()
+          .key("id").value(id)
+          .key("id_plus_one").value(id + 1)
+          .key("tok").value(tok)
+          .key("page").value(page)
+        .end_object();
+     });
+   }
+
+   // GET /report
+   void report( restd::http_request& req, restd::http_response& resp ) {
+     // pretend this is expensive
+     std::this_thread::sleep_for( std::chrono::seconds(2) );
+     resp.text( "Here's your report." );
+   }
+
+   // GET /count?to=N
+   void count( restd::http_request& req, restd::http_response& resp ) {
+     uint64_t to = req.param<uint64_t>( "to", 100000 ),
+              i  = 0;
+
+     // lines are produced while the client reads them, no matter how many.
+     resp.stream( [=]( restd::http_stream_writer& w ) mutable {
+       char line[32];
+       for( int n = 0; n < 1000 && i < to; ++n ) {
+         int len = snprintf( line, sizeof(line), "%lu\n", ++i );
+         w.write( line, len );
+       }
+       return i < to;
+     }, "text/plain" );
+   }
+
    // GET /form
    void form( restd::http_request& req, restd::http_response& resp ) {
       std::stringstream ss;
@@ -123,6 +171,14 @@ class hello_world : public restd::http_controller {
       NESTED( "req.cookies", req.cookies );
       NESTED( "req.parameters", req.parameters );
 
+      ss << "<tr><td width='10%' style='font-weight:bold'>req.path_params</td><td>";
+        ss << "<table width='100%' border='0'>";
+        for( size_t i = 0; i < req.n_path_params; ++i ){
+          KV_LINE( req.path_params[i].name, req.path_params[i].value );
+        }
+        ss << "</table>";
+      ss << "</td></tr>";
+
       KV_LINE( "&nbsp;", "&nbsp;" );
 
       KV_LINE( "req.body", req.body );
@@ -133,44 +189,68 @@ class hello_world : public restd::http_controller {
     }
 };
 
+// adds CORS headers to every response of the group.
+struct cors {
+  template <typename Next>
+  void operator()( restd::http_request& req, restd::http_response& resp, Next&& next ) const {
+    next();
+    resp.headers["Access-Control-Allow-Origin"] = "*";
+  }
+};
+
+// reports how long the rest of the chain took.
+struct timing {
+  template <typename Next>
+  void operator()( restd::http_request& req, restd::http_response& resp, Next&& next ) const {
+    auto start = std::chrono::steady_clock::now();
+    next();
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>( std::chrono::steady_clock::now() - start );
+    resp.headers["Server-Timing"] = "app;dur=" + std::to_string( elapsed.count() / 1000.0 );
+  }
+};
+
 typedef struct {
   std::string        address;
   unsigned short     port;
   restd::log_level_t llevel;
   unsigned int       workers;
+  std::string        cpus;
 }
 args_t;
 
 static args_t args = {
-  .address = "127.0.0.1",
-  .port = 8080,
-  .llevel = restd::INFO,
-  .workers = std::thread::hardware_concurrency()
+  "127.0.0.1",                          // address
+  8080,                                 // port
+  restd::INFO,                          // llevel
+  std::thread::hardware_concurrency(),  // workers
+  ""                                    // cpus
 };
 
 static struct option long_options[] = {
     { "address", required_argument, NULL, 'a' },
     { "port",    required_argument, NULL, 'p' },
     { "workers", required_argument, NULL, 'w' },
+    { "cpus",    required_argument, NULL, 'c' },
     { "debug",   no_argument,       NULL, 'd' },
 
     {NULL, 0, NULL, 0}
 };
 
 void usage(char *argvz) {
-  printf( "Usage: %s <-a|--address ADDRESS> <-p|--port PORT> <-w|--workers N_WORKERS> <-d|--debug>\n", argvz );
+  printf( "Usage: %s <-a|--address ADDRESS> <-p|--port PORT> <-w|--workers N_WORKERS> <-c|--cpus CPU_LIST> <-d|--debug>\n", argvz );
 }
 
 int main(int argc, char **argv)
 {
   int c;
 
-  while( (c = getopt_long(argc, argv, "a:p:w:dh", long_options, NULL)) != -1) {
+  while( (c = getopt_long(argc, argv, "a:p:w:c:dh", long_options, NULL)) != -1) {
     switch(c) {
       case 'a': args.address = optarg; break;
       case 'p': args.port    = atoi(optarg); break;
       case 'd': args.llevel  = restd::DEBUG; break;
       case 'w': args.workers = atoi(optarg); break;
+      case 'c': args.cpus    = optarg; break;
 
       default:
           usage(argv[0]);
@@ -189,11 +269,26 @@ int main(int argc, char **argv)
     
     hello_world hw;
 
+    // -c 0-3 or -c eth0 to follow the NIC interrupts.
+    if( !args.cpus.empty() ) {
+      restd::affinity::cpu_list_t cpus;
+      if( !restd::affinity::parse( args.cpus, cpus ) ) {
+        cpus = restd::affinity::nic_cpus( args.cpus );
+      }
+      server.pin_acceptor( cpus );
+      server.pin_workers( cpus );
+    }
+
+    // gzip / deflate responses for clients accepting them.
+    server.compress();
+    server.compression().min_size = 32;
+
     // simple GET routes
     RESTD_ROUTE( server, restd::GET,  "/",      hw, hello_world::index );
-    RESTD_ROUTE( server, restd::GET,  "/hello", hw, hello_world::hello );
-    // return a json response from data structure
-    RESTD_ROUTE( server, restd::GET,  "/json",  hw, hello_world::json );
+    // the same name always gets the same greeting, keep it around for 10 seconds.
+    RESTD_ROUTE( server, restd::GET,  "/hello", hw, hello_world::hello )->cache( 10, { { "name" }, {} } );
+    // return a json response from data structure, clients polling it get a 304 if it didn't change.
+    RESTD_ROUTE( server, restd::GET,  "/json",  hw, hello_world::json )->compress_cached()->etag();
     // parses json request and echoes it back if valid
     RESTD_ROUTE( server, restd::POST, "/jecho", hw, hello_world::jecho );
     // a form to test POST to /debug
@@ -202,8 +297,110 @@ int main(int argc, char **argv)
     RESTD_ROUTE( server, restd::ANY,  "/debug", hw, hello_world::debug );
     // route with named parameters and validators.
     RESTD_ROUTE( server, restd::GET,  "/named/:hash([a-f0-9]{32})/?:optional(.*)", hw, hello_world::debug );
+    // route with typed parameters, validated while matching.
+    RESTD_ROUTE( server, restd::GET,  "/typed/:id<int>/:tok<uuid>", hw, hello_world::typed )->param_views();
+    // handlers don't need to be controller methods.
+    server.route( "/ping", []( restd::http_request& req, restd::http_response& resp ) {
+      resp.text( "pong" );
+    }, restd::GET )->prioritize( restd::PRIORITY_HIGH );
+    // handlers knowing their version save the body hashing.
+    server.route( "/version", []( restd::http_request& req, restd::http_response& resp ) {
+      resp.text( "1.0.0" );
+      resp.etag( "v1.0.0" );
+    }, restd::GET )->etag();
+    // concurrent requests wait for the one already running and share its response.
+    server.route( "/slow", []( restd::http_request& req, restd::http_response& resp ) {
+      std::this_thread::sleep_for( std::chrono::seconds(1) );
+      resp.text( "Computed at " + std::to_string( time(NULL) ) );
+    }, restd::GET )->coalesce();
+    // fans out to subtasks running on this worker's deque, idle workers steal them.
+    server.route( "/fanout", []( restd::http_request& req, restd::http_response& resp ) {
+      std::atomic<uint64_t> total(0);
+      restd::task_group     group;
+
+      for( uint64_t part = 0; part < 4; ++part ) {
+        group.run( [part, &total]() {
+          uint64_t sum = 0;
+          for( uint64_t i = part * 1000000; i < ( part + 1 ) * 1000000; ++i ) {
+            sum += i;
+          }
+          total += sum;
+        });
+      }
+      group.wait();
+
+      resp.text( std::to_string( total.load() ) );
+    }, restd::GET );
+    // shelling out blocks, this runs on the blocking pool instead of a worker.
+    server.route( "/uptime", []( restd::http_request& req, restd::http_response& resp ) {
+      std::string out;
+      char        line[256];
+      FILE       *cmd = popen( "uptime", "r" );
+
+      while( cmd && fgets( line, sizeof(line), cmd ) ) {
+        out += line;
+      }
+      if( cmd ) {
+        pclose( cmd );
+      }
+
+      resp.text( out );
+    }, restd::GET )->blocking();
+#if defined(__cpp_impl_coroutine)
+    // suspended coroutines don't hold a worker, thousands can wait at once.
+    server.route( "/later", []( restd::http_request& req, restd::http_response& resp ) -> restd::async<> {
+      co_await restd::sleep_for( std::chrono::milliseconds(200) );
+      resp.text( "Sorry for the wait." );
+    }, restd::GET );
+#endif
+    // always the same bytes, serialized once.
+    server.constant( "/robots.txt", restd::http_response( restd::http_response::HTTP_STATUS_OK, "User-agent: *\nDisallow: /\n" ) );
+    server.constant( "/health", restd::http_response( restd::http_response::HTTP_STATUS_OK, "{\"status\":\"ok\"}", "application/json" ) );
+    // clients of /events get a tick every second, without holding a worker while they wait.
+    static restd::http_sse_channel ticks( "ticks" );
+    std::atomic<bool> ticking( true );
+    std::thread ticker( [&ticking]() {
+      while( ticking ) {
+        std::this_thread::sleep_for( std::chrono::seconds(1) );
+        ticks.publish( std::to_string( time(NULL) ), "tick" );
+      }
+    });
+    server.route( "/events", []( restd::http_request& req, restd::http_response& resp ) {
+      resp.subscribe( ticks );
+    }, restd::GET );
+    // routes sharing a prefix and a middleware chain.
+    auto api = server.group( "/api", timing(), cors() );
+    api.route<&hello_world::json>( "/json", &hw, restd::GET );
+    api.route<&hello_world::typed>( "/typed/:id<int>/:tok<uuid>", &hw, restd::GET );
+    // only reachable as http://localhost:<port>/whoami
+    server.host( "localhost" ).route( "/whoami", []( restd::http_request& req, restd::http_response& resp ) {
+      resp.text( "You're talking to " + req.host );
+    }, restd::GET );
+    // chunked response generated on the fly
+    RESTD_ROUTE( server, restd::GET,  "/count", hw, hello_world::count );
+    // at most one report at a time and two waiting, the rest get a 503.
+    RESTD_ROUTE( server, restd::GET,  "/report", hw, hello_world::report )->limit( server.bulkhead( "reports", 1, 2 ) );
     
+    // connections waiting too long for a worker get a 503 right away.
+    server.shed_load( 20, 100, 1 );
+
+    // when workers are busy, pings go first and batch clients last.
+    server.prioritize( []( const restd::http_request& req, restd::tcp_stream *client, restd::Priority priority ) {
+      return req.has_header("X-Batch") ? restd::PRIORITY_LOW : priority;
+    });
+
+    // a client flooding the server only delays its own requests.
+    server.fair_queue( "X-Api-Key" );
+
+    // ^C or kill let the requests in flight finish before exiting.
+    server.stop_on( SIGTERM );
+    server.stop_on( SIGINT );
+    server.drain_timeout = 5;
+
     server.start();
+
+    ticking = false;
+    ticker.join();
   }
   catch( const exception& e ) {
     restd::log( restd::CRITICAL, "Exception: %s", e.what() );
@@ -0,0 +1,46 @@
+/*
+ * This file is part of librestd.
+ *
+ * Copyleft of Simone Margaritelli aka evilsocket <evilsocket@protonmail.com>
+ *
+ * librestd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * librestd is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with librestd.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace restd {
+namespace affinity {
+
+typedef std::vector<int> cpu_list_t;
+
+// Parses the kernel's cpu list format, "0-3,8,10-11".
+bool parse( const std::string& list, cpu_list_t& cpus );
+// Formats cpus back to the same format, mostly for logging.
+std::string format( const cpu_list_t& cpus );
+
+// Pins the calling thread to cpus, false if the kernel refused.
+bool pin( const cpu_list_t& cpus );
+// NUMA node of cpu, 0 if unknown or on machines without NUMA.
+int node_of( int cpu );
+
+// CPUs serving the interrupts of a network interface ( as listed in
+// /proc/irq/N/smp_affinity_list for each of its MSI vectors ), pinning
+// the acceptor and workers there keeps packets and requests on the same
+// cores and NUMA node. Empty if it can't be figured out.
+cpu_list_t nic_cpus( const std::string& interface );
+
+}
+}
@@ -0,0 +1,343 @@
+/*
+ * This file is part of librestd.
+ *
+ * Copyleft of Simone Margaritelli aka evilsocket <evilsocket@protonmail.com>
+ *
+ * librestd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * librestd is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with librestd.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+// Coroutines need C++20, build with -DRESTD_COROUTINES=ON to get them.
+#if defined(__cpp_impl_coroutine)
+
+#include "scheduler.h"
+
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <chrono>
+#include <atomic>
+#include <thread>
+#include <cstdint>
+#include <sys/types.h>
+
+namespace restd {
+
+template <typename T> class async;
+
+// Bookkeeping shared by every async<T>: who to resume when done and the
+// exception to rethrow there, if any.
+class async_promise_base
+{
+  public:
+
+    std::coroutine_handle<> continuation;
+    std::exception_ptr      error;
+
+    struct final_awaiter {
+      inline bool await_ready() noexcept {
+        return false;
+      }
+
+      // resumes whoever awaited us right away, no stack growth.
+      template <typename P>
+      inline std::coroutine_handle<> await_suspend( std::coroutine_handle<P> self ) noexcept {
+        std::coroutine_handle<> next = self.promise().continuation;
+        return next ? next : std::noop_coroutine();
+      }
+
+      inline void await_resume() noexcept {}
+    };
+
+    // nothing runs until the coroutine is awaited.
+    inline std::suspend_always initial_suspend() noexcept {
+      return {};
+    }
+
+    inline final_awaiter final_suspend() noexcept {
+      return {};
+    }
+
+    inline void unhandled_exception() {
+      error = std::current_exception();
+    }
+};
+
+template <typename T>
+class async_promise : public async_promise_base
+{
+  private:
+
+    std::optional<T> _value;
+
+  public:
+
+    async<T> get_return_object();
+
+    inline void return_value( T value ) {
+      _value = std::move(value);
+    }
+
+    inline T result() {
+      if( error ) {
+        std::rethrow_exception( error );
+      }
+      return std::move( *_value );
+    }
+};
+
+template <>
+class async_promise<void> : public async_promise_base
+{
+  public:
+
+    async<void> get_return_object();
+
+    inline void return_void() {}
+
+    inline void result() {
+      if( error ) {
+        std::rethrow_exception( error );
+      }
+    }
+};
+
+// A lazily started coroutine returning T, co_await it to run it and get
+// its result ( or its exception ). Asynchronous handlers return async<>:
+//
+//   restd::async<> handler( restd::http_request& req, restd::http_response& resp ) {
+//     co_await restd::sleep_for( std::chrono::milliseconds(100) );
+//     resp.text( "later" );
+//   }
+template <typename T = void>
+class async
+{
+  public:
+
+    typedef async_promise<T> promise_type;
+
+  private:
+
+    std::coroutine_handle<promise_type> _handle;
+
+  public:
+
+    explicit async( std::coroutine_handle<promise_type> handle ) : _handle(handle) {}
+    async( async&& other ) noexcept : _handle(other._handle) {
+      other._handle = nullptr;
+    }
+
+    async( const async& ) = delete;
+    async& operator=( const async& ) = delete;
+
+    ~async() {
+      if( _handle ) {
+        _handle.destroy();
+      }
+    }
+
+    inline bool await_ready() const noexcept {
+      return false;
+    }
+
+    inline std::coroutine_handle<> await_suspend( std::coroutine_handle<> awaiting ) noexcept {
+      _handle.promise().continuation = awaiting;
+      return _handle;
+    }
+
+    inline T await_resume() {
+      return _handle.promise().result();
+    }
+
+    struct completion_awaiter {
+      std::coroutine_handle<promise_type> handle;
+
+      inline bool await_ready() const noexcept {
+        return false;
+      }
+
+      inline std::coroutine_handle<> await_suspend( std::coroutine_handle<> awaiting ) noexcept {
+        handle.promise().continuation = awaiting;
+        return handle;
+      }
+
+      inline void await_resume() noexcept {}
+    };
+
+    // Awaiting this runs the coroutine without fetching its result.
+    inline completion_awaiter completion() {
+      return completion_awaiter{ _handle };
+    }
+
+    inline T result() {
+      return _handle.promise().result();
+    }
+};
+
+template <typename T>
+inline async<T> async_promise<T>::get_return_object() {
+  return async<T>( std::coroutine_handle<async_promise<T>>::from_promise(*this) );
+}
+
+inline async<void> async_promise<void>::get_return_object() {
+  return async<void>( std::coroutine_handle<async_promise<void>>::from_promise(*this) );
+}
+
+// Fire and forget coroutine, it starts right away and frees itself once
+// done. Used to run an async<> to completion from plain code.
+struct detached {
+  struct promise_type {
+    inline detached get_return_object() noexcept {
+      return {};
+    }
+
+    inline std::suspend_never initial_suspend() noexcept {
+      return {};
+    }
+
+    inline std::suspend_never final_suspend() noexcept {
+      return {};
+    }
+
+    inline void return_void() noexcept {}
+
+    inline void unhandled_exception() noexcept {
+      std::terminate();
+    }
+  };
+};
+
+// Resumes handle on pool, or right here if there's no pool.
+void resume_on( scheduler *pool, std::coroutine_handle<> handle );
+
+// Suspends the coroutine until a point in time, the wait is on the timer
+// thread and the coroutine goes back to the worker pool it came from.
+class timer_awaiter
+{
+  private:
+
+    std::chrono::steady_clock::time_point _when;
+
+  public:
+
+    explicit timer_awaiter( std::chrono::steady_clock::time_point when ) : _when(when) {}
+
+    inline bool await_ready() const noexcept {
+      return _when <= std::chrono::steady_clock::now();
+    }
+
+    void await_suspend( std::coroutine_handle<> handle );
+
+    inline void await_resume() noexcept {}
+};
+
+inline timer_awaiter sleep_until( std::chrono::steady_clock::time_point when ) {
+  return timer_awaiter( when );
+}
+
+inline timer_awaiter sleep_for( std::chrono::steady_clock::duration duration ) {
+  return timer_awaiter( std::chrono::steady_clock::now() + duration );
+}
+
+// Suspends the coroutine until a descriptor is readable or writable,
+// co_await returns false if it can't be waited for. Only one coroutine
+// at a time can wait on the same descriptor.
+class fd_awaiter
+{
+  friend class io_loop;
+
+  private:
+
+    int                     _fd;
+    uint32_t                _events;
+    int                     _error;
+    scheduler              *_pool;
+    std::coroutine_handle<> _handle;
+
+  public:
+
+    fd_awaiter( int fd, uint32_t events ) : _fd(fd), _events(events), _error(0), _pool(NULL) {}
+
+    inline bool await_ready() const noexcept {
+      return false;
+    }
+
+    bool await_suspend( std::coroutine_handle<> handle );
+
+    inline bool await_resume() const noexcept {
+      return _error == 0;
+    }
+};
+
+fd_awaiter readable( int fd );
+fd_awaiter writable( int fd );
+
+// Reads from a non blocking descriptor, suspending instead of blocking
+// until there's something to read, returns the same as read(2).
+async<ssize_t> async_read( int fd, void *buffer, size_t size );
+// Writes everything to a non blocking descriptor, returns the number of
+// bytes written or -1 on the first error.
+async<ssize_t> async_write( int fd, const void *buffer, size_t size );
+
+// Moves the rest of the coroutine to the back of the worker pool it's
+// running on, giving the queued requests a turn.
+class schedule_awaiter
+{
+  private:
+
+    scheduler *_pool;
+
+  public:
+
+    schedule_awaiter() : _pool( scheduler::current() ) {}
+
+    inline bool await_ready() const noexcept {
+      return _pool == NULL;
+    }
+
+    inline void await_suspend( std::coroutine_handle<> handle ) {
+      _pool->submit( [handle]() {
+        handle.resume();
+      });
+    }
+
+    inline void await_resume() noexcept {}
+};
+
+inline schedule_awaiter schedule() {
+  return schedule_awaiter();
+}
+
+template <typename T>
+detached notify_when_done( async<T>& coroutine, latch& done ) {
+  co_await coroutine.completion();
+  done.set();
+}
+
+// Runs coroutine to completion from plain code and returns its result.
+// The caller sleeps meanwhile, on a worker it only runs queued tasks if
+// every other worker is waiting too, see latch.
+template <typename T>
+T block_on( async<T> coroutine ) {
+  latch done;
+
+  notify_when_done( coroutine, done );
+  done.wait();
+
+  return coroutine.result();
+}
+
+}
+
+#endif
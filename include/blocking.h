@@ -0,0 +1,175 @@
+/*
+ * This file is part of librestd.
+ *
+ * Copyleft of Simone Margaritelli aka evilsocket <evilsocket@protonmail.com>
+ *
+ * librestd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * librestd is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with librestd.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include "scheduler.h"
+#include "async.h"
+
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <optional>
+#include <exception>
+#include <type_traits>
+#include <condition_variable>
+
+namespace restd {
+
+// Elastic pool for code that blocks on something other than the CPU:
+// fsync, shelling out, legacy clients without timeouts. Threads are
+// started when every other one is busy, up to max_threads, and exit
+// after being idle for keep_alive, so the workers parsing and routing
+// requests are never the ones stuck waiting.
+class blocking_pool
+{
+  private:
+
+    std::mutex              _mutex;
+    std::condition_variable _wakeup;
+    std::condition_variable _done;
+    std::deque<task_t>      _tasks;
+    unsigned int            _threads;
+    unsigned int            _idle;
+    bool                    _running;
+
+    void run();
+
+  public:
+
+    // Beyond this tasks wait for a thread to be free.
+    unsigned int         max_threads;
+    std::chrono::seconds keep_alive;
+
+    blocking_pool( unsigned int max_threads = 64 );
+    // Runs what's left and waits for the threads to exit.
+    ~blocking_pool();
+
+    blocking_pool( const blocking_pool& ) = delete;
+    blocking_pool& operator=( const blocking_pool& ) = delete;
+
+    // The pool used by blocking routes, blocking() and offload().
+    static blocking_pool& shared();
+
+    void submit( task_t task );
+
+    inline unsigned int threads() {
+      std::lock_guard<std::mutex> lock(_mutex);
+      return _threads;
+    }
+};
+
+// Runs fn on the blocking pool and returns its result. Meanwhile the
+// worker sleeps, unless every other one is waiting too, see latch.
+// Outside of a worker fn runs right away.
+template <typename F>
+auto blocking( F&& fn ) -> decltype( fn() ) {
+  typedef decltype( fn() ) result_t;
+
+  if( scheduler::current() == NULL ) {
+    return fn();
+  }
+
+  latch              done;
+  std::exception_ptr error;
+  std::optional<typename std::conditional<std::is_void<result_t>::value, bool, result_t>::type> result;
+
+  blocking_pool::shared().submit( [&]() {
+    try {
+      if constexpr( std::is_void<result_t>::value ) {
+        fn();
+      } else {
+        result.emplace( fn() );
+      }
+    }
+    catch( ... ) {
+      error = std::current_exception();
+    }
+    done.set();
+  });
+
+  done.wait();
+
+  if( error ) {
+    std::rethrow_exception( error );
+  }
+  if constexpr( !std::is_void<result_t>::value ) {
+    return std::move( *result );
+  }
+}
+
+#if defined(__cpp_impl_coroutine)
+// Runs fn on the blocking pool while the coroutine is suspended, then
+// resumes it on the worker pool it came from with fn's result.
+template <typename F>
+class offload_awaiter
+{
+  private:
+
+    typedef typename std::invoke_result<F&>::type result_t;
+
+    F                  _fn;
+    scheduler         *_pool;
+    std::exception_ptr _error;
+    std::optional<typename std::conditional<std::is_void<result_t>::value, bool, result_t>::type> _result;
+
+  public:
+
+    explicit offload_awaiter( F fn ) : _fn( std::move(fn) ), _pool(NULL) {}
+
+    inline bool await_ready() const noexcept {
+      return false;
+    }
+
+    void await_suspend( std::coroutine_handle<> handle ) {
+      _pool = scheduler::current();
+
+      blocking_pool::shared().submit( [this, handle]() {
+        try {
+          if constexpr( std::is_void<result_t>::value ) {
+            _fn();
+          } else {
+            _result.emplace( _fn() );
+          }
+        }
+        catch( ... ) {
+          _error = std::current_exception();
+        }
+        resume_on( _pool, handle );
+      });
+    }
+
+    result_t await_resume() {
+      if( _error ) {
+        std::rethrow_exception( _error );
+      }
+      if constexpr( !std::is_void<result_t>::value ) {
+        return std::move( *_result );
+      }
+    }
+};
+
+template <typename F>
+offload_awaiter<typename std::decay<F>::type> offload( F&& fn ) {
+  return offload_awaiter<typename std::decay<F>::type>( std::forward<F>(fn) );
+}
+#endif
+
+}
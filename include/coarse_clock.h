@@ -0,0 +1,116 @@
+/*
+ * This file is part of librestd.
+ *
+ * Copyleft of Simone Margaritelli aka evilsocket <evilsocket@protonmail.com>
+ *
+ * librestd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * librestd is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with librestd.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <ctime>
+
+namespace restd {
+
+// Wall clock with one second resolution shared by the whole process: a
+// background thread wakes up at every second boundary and publishes the
+// current time together with a preformatted RFC 7231 Date header value
+// and log timestamp, so the hot paths just copy them.
+class coarse_clock
+{
+  public:
+
+    static const size_t date_size = 29;
+    static const size_t stamp_size = 0xFF;
+
+    // "Sun, 06 Nov 1994 08:49:37 GMT", not NUL terminated.
+    typedef struct {
+      char value[date_size];
+    }
+    date_t;
+
+  private:
+
+    static const unsigned int n_slots = 4;
+
+    typedef struct {
+      // odd while the slot is being written.
+      std::atomic<unsigned> seq;
+      time_t                now;
+      char                  date[date_size + 1];
+      char                  stamp[stamp_size];
+      size_t                stamp_len;
+    }
+    slot_t;
+
+    // readers always get the last published slot, the writer only ever
+    // touches the next one.
+    slot_t                  _slots[n_slots];
+    std::atomic<unsigned>   _current;
+    std::string             _log_format;
+    std::mutex              _mutex;
+    std::condition_variable _wakeup;
+    bool                    _running;
+    std::thread             _thread;
+
+    coarse_clock();
+    ~coarse_clock();
+
+    static coarse_clock& instance();
+
+    void tick();
+    void run();
+
+    inline const slot_t& current() const {
+      return _slots[ _current.load( std::memory_order_acquire ) ];
+    }
+
+    // Copies out of the current slot with copy, again if a tick reused it meanwhile.
+    template <typename F>
+    static void read( F copy ) {
+      while( true ) {
+        const slot_t& slot = instance().current();
+        unsigned      seq  = slot.seq.load( std::memory_order_acquire );
+        if( seq & 1 ) {
+          continue;
+        }
+
+        copy( slot );
+
+        std::atomic_thread_fence( std::memory_order_acquire );
+        if( slot.seq.load( std::memory_order_relaxed ) == seq ) {
+          return;
+        }
+      }
+    }
+
+  public:
+
+    // Seconds since the epoch as of the last tick.
+    static time_t now();
+    // The current Date header value, a copy that can be held for as long as needed.
+    static date_t date();
+    // Copies the local time formatted with the log date format to out, which
+    // must hold stamp_size bytes, returns its length.
+    static size_t log_timestamp( char *out );
+
+    static void set_log_format( const char *format );
+};
+
+}
@@ -0,0 +1,62 @@
+/*
+ * This file is part of librestd.
+ *
+ * Copyleft of Simone Margaritelli aka evilsocket <evilsocket@protonmail.com>
+ *
+ * librestd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * librestd is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with librestd.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+namespace restd {
+
+// Admission control based on how long requests have been queued ( their
+// sojourn time ) rather than on how many there are, after CoDel.
+//
+// The first request waiting more than target arms a deadline one interval
+// later, any request waiting less than target disarms it: until then the
+// queue is just absorbing a burst and nothing is shed. Once requests kept
+// waiting more than target for a whole interval there's a standing queue,
+// and anything queued for more than target is shed until one gets out in
+// time, so the ones left get an answer before their clients give up.
+class codel
+{
+  private:
+
+    std::chrono::nanoseconds _target;
+    std::chrono::nanoseconds _interval;
+    // when delays above target become a standing queue, 0 if disarmed.
+    std::atomic<int64_t>     _first_above;
+    std::atomic<uint64_t>    _shed;
+
+  public:
+
+    codel( std::chrono::milliseconds target = std::chrono::milliseconds(20), 
+           std::chrono::milliseconds interval = std::chrono::milliseconds(100) );
+
+    void configure( std::chrono::milliseconds target, std::chrono::milliseconds interval );
+
+    // Returns false if a request enqueued at enqueued should be shed.
+    bool admit( std::chrono::steady_clock::time_point enqueued );
+
+    // Requests shed so far.
+    inline uint64_t shed() const {
+      return _shed.load( std::memory_order_relaxed );
+    }
+};
+
+}
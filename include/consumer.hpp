@@ -33,26 +33,35 @@ class consumer
  
     void run() {
       while(_running) {
+        // NULL means the queue was closed and there's nothing left.
         T *item = _queue.get();
+        if( !item ) {
+          break;
+        }
         this->consume(item);
-        delete item;
       }
     }
 
   public:
 
     consumer(work_queue<T *>& queue) : _queue(queue), _running(false) {}
+    virtual ~consumer() {}
 
     void start() {
       _running = true;
       _thread = std::thread(&consumer::run, this);
     }
 
+    // Lets the queue drain, then joins.
     void stop() {
+      _queue.close();
+      if( _thread.joinable() ) {
+        _thread.join();
+      }
       _running = false;
-      _thread.join();
     }
 
+    // Takes ownership of item.
     virtual void consume( T *item ) = 0;
 };
 
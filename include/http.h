@@ -19,10 +19,13 @@
 #pragma once
 
 #include "strings.h"
+#include "http_params.h"
 #include "json.hpp"
+#include "json_writer.h"
 
 #include <vector>
 #include <map>
+#include <functional>
 
 using std::string;
 using std::vector;
@@ -32,11 +35,14 @@ namespace restd {
 
 using json = nlohmann::json;
 
+class http_stream_writer;
+class http_sse_channel;
+
 #define HTTP_END_OF_HEADERS    "\r\n\r\n"
 #define HTTP_END_OF_HEADERS_SZ 4
 
 typedef std::map<std::string, std::string> headers_t;
-typedef std::map<std::string, std::string> params_t;
+typedef std::map<std::string, std::string, std::less<>> params_t;
 typedef std::map<std::string, std::string> cookies_t;
 
 typedef enum {
@@ -75,6 +81,7 @@ class http_request
 
     static const unsigned int chunk_size = 8192;
     static const unsigned int read_timeout = 1;
+    static const unsigned int max_path_params = 16;
 
     RequestParserState parser_state;
     std::string    raw;
@@ -86,6 +93,8 @@ class http_request
     std::string    host;
     headers_t      headers;
     params_t       parameters;
+    path_param     path_params[max_path_params];
+    size_t         n_path_params;
     cookies_t      cookies;
     int            content_length;
     std::string    body;
@@ -131,17 +140,58 @@ class http_request
       return header_is( "Content-Type", "application/json" );
     }
 
+    // Looks for a named path parameter first, then for a query or
+    // form parameter, the returned view is valid as long as the request.
+    inline bool raw_param( const char *name, std::string_view& value ) const {
+      for( size_t i = 0; i < n_path_params; ++i ) {
+        if( strcmp( path_params[i].name, name ) == 0 ) {
+          value = path_params[i].value;
+          return true;
+        }
+      }
+
+      auto i = parameters.find(name);
+      if( i != parameters.end() ) {
+        value = i->second;
+        return true;
+      }
+
+      return false;
+    }
+
     inline bool has_parameter( const char *name ) const {
-      return parameters.find(name) != parameters.end();
+      std::string_view value;
+      return raw_param( name, value );
     }
 
-    inline string param( const char *name, const char *deflt = "" ) {
-      if( has_parameter(name) ){
-        return parameters[name];
+    inline string param( const char *name, const char *deflt = "" ) const {
+      std::string_view value;
+      if( raw_param( name, value ) ){
+        return string( value );
       }
       return string(deflt);
     }
 
+    // Typed accessors, param<int64_t>("id"), param<uuid>("id") and so on, 
+    // values are parsed in place from the request bytes.
+    template <typename T>
+    inline bool try_param( const char *name, T& value ) const {
+      std::string_view raw;
+      if( raw_param( name, raw ) ){
+        return param_parser<T>::parse( raw, value );
+      }
+      return false;
+    }
+
+    template <typename T>
+    inline T param( const char *name, T deflt = T() ) const {
+      T value;
+      if( try_param<T>( name, value ) ){
+        return value;
+      }
+      return deflt;
+    }
+
 };
 
 class http_response 
@@ -165,6 +215,7 @@ class http_response
       HTTP_STATUS_UNAUTHORIZED =        401,
       HTTP_STATUS_FORBIDDEN =           403,
       HTTP_STATUS_NOT_FOUND =           404,
+      HTTP_STATUS_NOT_ACCEPTABLE =      406,
       HTTP_STATUS_INTERNAL =            500,
       HTTP_STATUS_NOT_IMPLEMENTED =     501,
       HTTP_STATUS_BAD_GATEWAY =         502,
@@ -172,25 +223,93 @@ class http_response
     }
     Status;
 
-    Status    status;
-    headers_t headers;
-    string    body;
+    typedef std::function<void( json_writer& )> json_stream_t;
+    // Called until it returns false, each call writes the next piece of the body.
+    typedef std::function<bool( http_stream_writer& )> stream_generator_t;
+
+    Status         status;
+    headers_t      headers;
+    string         body;
+    // JSON bodies are kept as they are and written as compact JSON straight
+    // into the output buffer at serialization time, see json() overloads.
+    nlohmann::json     json_body;
+    json_stream_t      json_stream;
+    // Chunked bodies, sent while they're being generated.
+    stream_generator_t generator;
+    // Server-Sent Events channel the client is handed over to.
+    http_sse_channel  *channel;
 
     http_response( Status status_, string body_ = "", string content_type = "text/plain" );
     http_response();
 
     void bad_request();
     void not_found();
+    void not_acceptable();
+    void unavailable( unsigned int retry_after );
+    // Empty 304, validators already set are kept.
+    void not_modified();
+    // Tags the current representation with version, routes with etag()
+    // enabled use it as the ETag instead of hashing the body.
+    void etag( const string& version, bool weak = false );
 
     void text( string text, http_response::Status status = http_response::HTTP_STATUS_OK );
     void html( string html, http_response::Status status = http_response::HTTP_STATUS_OK );
     void json( string json, http_response::Status status = http_response::HTTP_STATUS_OK );
+    void json( const char *json, http_response::Status status = http_response::HTTP_STATUS_OK );
+    void json( nlohmann::json json, http_response::Status status = http_response::HTTP_STATUS_OK );
+    // stream will be called with a writer on the output buffer.
+    void stream_json( json_stream_t stream, http_response::Status status = http_response::HTTP_STATUS_OK );
+    // Sends the body with Transfer-Encoding: chunked as generator produces it.
+    void stream( stream_generator_t generator, const char *content_type = "application/octet-stream", http_response::Status status = http_response::HTTP_STATUS_OK );
+
+    // Sends the event stream headers, then parks the connection in channel
+    // without holding a worker, see http_sse_channel.
+    void subscribe( http_sse_channel& channel );
+
+    inline bool is_subscription() const {
+      return channel != NULL;
+    }
+
+    inline bool is_streaming() const {
+      return (bool)generator;
+    }
 
-    std::string str();
+    inline bool has_json_body() const {
+      return _json_mode != JSON_NONE;
+    }
+
+    // Appends the serialized response to out, workers reuse the same
+    // buffer across requests so this usually doesn't allocate. Returns
+    // the size of the body. Streaming, subscriptions, 204 and 304 responses
+    // only get their headers.
+    size_t serialize( std::string& out ) const;
+    // Same as above but with body in place of our own, used for compressed
+    // or cached variants of the body.
+    size_t serialize( std::string& out, std::string_view body ) const;
+    // Appends just the body, JSON bodies are serialized.
+    size_t write_body( std::string& out ) const;
+    // Serializes a JSON body into body, so the response no longer depends
+    // on what a stream refers to and can be copied around.
+    void flatten();
+    std::string str() const;
   
   private:
 
-    static string statusMessage( http_response::Status s );
+    typedef enum {
+      JSON_NONE = 0,
+      JSON_VALUE,
+      JSON_STREAM
+    }
+    JsonMode;
+
+    JsonMode _json_mode;
+
+    void set_body( string body, http_response::Status status, const char *content_type );
+    // Status line and headers up to the Content-Length, if own_length a
+    // user defined Content-Length is skipped. Returns true if one was set.
+    bool serialize_head( std::string& out, bool own_length ) const;
+
+    static const char *statusMessage( http_response::Status s );
 };
 
 }
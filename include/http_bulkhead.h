@@ -0,0 +1,102 @@
+/*
+ * This file is part of librestd.
+ *
+ * Copyleft of Simone Margaritelli aka evilsocket <evilsocket@protonmail.com>
+ *
+ * librestd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * librestd is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with librestd.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include "work_queue.hpp"
+#include "consumer.hpp"
+#include "http_job.h"
+#include "scheduler.h"
+
+#include <atomic>
+
+namespace restd {
+
+class http_bulkhead;
+
+class http_bulkhead_consumer : public consumer<http_job>
+{
+  private:
+
+    http_bulkhead *_bulkhead;
+
+  public:
+
+    http_bulkhead_consumer(work_queue<http_job *>& queue, http_bulkhead *bulkhead) : consumer(queue), _bulkhead(bulkhead) {}
+
+    virtual void consume( http_job *job );
+};
+
+// Caps how many requests of a route ( or group of routes ) can be handled
+// at the same time, so a slow endpoint can't take every worker.
+//
+// Without dedicated threads, up to max_concurrent requests run on the
+// http_consumer that parsed them, up to max_queued more wait in a list
+// ( without holding any thread ) and each request finishing hands the
+// next one back to the workers, anything beyond that is rejected right
+// away with a 503.
+//
+// With dedicated threads, requests are handed to a private pool of that
+// size, which is also how many run at the same time, and max_queued
+// bounds its queue.
+class http_bulkhead
+{
+  friend class http_bulkhead_consumer;
+
+  private:
+
+    string                         _name;
+    unsigned int                   _max_concurrent;
+    unsigned int                   _max_queued;
+    unsigned int                   _threads;
+    std::mutex                     _mutex;
+    unsigned int                   _running;
+    list<http_job *>               _pending;
+    std::atomic<unsigned int>      _queued;
+    work_queue<http_job *>         _queue;
+    list<http_bulkhead_consumer *> _consumers;
+    // where queued requests are resumed, the calling thread if NULL.
+    scheduler                     *_pool;
+
+    void execute( http_job *job );
+    void reject( http_job *job );
+    // Runs job in one of the max_concurrent slots, then passes the slot on.
+    void run( http_job *job );
+
+  public:
+
+    static const unsigned int retry_after = 1;
+
+    // With threads, max_concurrent must be the same number.
+    http_bulkhead( string name, unsigned int max_concurrent, unsigned int max_queued = 0, unsigned int threads = 0, scheduler *pool = NULL );
+    virtual ~http_bulkhead();
+
+    // Lets the dedicated pool finish its queue, then joins it.
+    void stop();
+
+    inline const string& name() const {
+      return _name;
+    }
+
+    // Takes ownership of job, it will be handled, queued or rejected.
+    void submit( http_job *job );
+
+    void start();
+};
+
+}
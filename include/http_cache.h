@@ -0,0 +1,117 @@
+/*
+ * This file is part of librestd.
+ *
+ * Copyleft of Simone Margaritelli aka evilsocket <evilsocket@protonmail.com>
+ *
+ * librestd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * librestd is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with librestd.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include "http.h"
+#include "http_compression.h"
+#include "tcp_stream.h"
+
+#include <list>
+#include <mutex>
+#include <memory>
+#include <vector>
+#include <unordered_map>
+#include <atomic>
+#include <ctime>
+
+namespace restd {
+
+class http_route;
+
+// Besides method, Host and path, the query parameters and headers whose
+// values make two requests to a cached route different.
+typedef struct {
+  std::vector<string> params;
+  std::vector<string> headers;
+}
+http_cache_key;
+
+// A fully serialized response, the Date header value is patched at
+// send time so it never goes stale.
+typedef struct {
+  std::shared_ptr<const string> bytes;
+  size_t                        date_at;
+}
+http_cached_t;
+
+// Sharded and memory bounded cache of serialized responses. Requests are
+// first mapped to the route that served the same method, Host and path
+// before, so hits skip routing, the handler and serialization.
+class http_cache
+{
+  private:
+
+    static const unsigned int n_shards = 16;
+    static const size_t       max_known_routes = 4096;
+
+    typedef struct {
+      string                        key;
+      std::shared_ptr<const string> bytes;
+      size_t                        date_at;
+      time_t                        expires;
+      std::list<uint64_t>::iterator lru;
+    }
+    entry_t;
+
+    typedef struct {
+      std::mutex                                mutex;
+      std::unordered_map<uint64_t, entry_t>     entries;
+      // most recently used first.
+      std::list<uint64_t>                       lru;
+      size_t                                    size;
+      std::unordered_map<uint64_t, http_route *> routes;
+    }
+    shard_t;
+
+    shard_t           _shards[n_shards];
+    // false until something is stored, spares the lookups if no route is cached.
+    std::atomic<bool> _used;
+
+    static uint64_t route_hash( const http_request& req );
+
+    inline shard_t& shard( uint64_t h ) {
+      return _shards[ ( h >> 32 ) % n_shards ];
+    }
+
+    void evict( shard_t& shard, std::unordered_map<uint64_t, entry_t>::iterator i );
+
+  public:
+
+    // Upper bound of the memory used by cached responses.
+    size_t max_bytes;
+
+    http_cache();
+
+    // Wraps serialized response bytes so they can be sent as they are.
+    static http_cached_t freeze( string bytes );
+    // Sends frozen bytes with the current Date in a single write.
+    static ssize_t send( tcp_stream *client, const http_cached_t& frozen );
+
+    // Writes the key of req for route in out, returns its hash.
+    static uint64_t key( const http_route *route, const http_request& req, ContentEncoding encoding, string& out );
+
+    // The cached route that served this method, Host and path, if any.
+    http_route *route_for( const http_request& req );
+
+    bool lookup( uint64_t hash, const string& key, http_cached_t& hit );
+    void store( http_route *route, const http_request& req, uint64_t hash, const string& key, const string& bytes );
+    void clear();
+};
+
+}
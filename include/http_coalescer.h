@@ -0,0 +1,74 @@
+/*
+ * This file is part of librestd.
+ *
+ * Copyleft of Simone Margaritelli aka evilsocket <evilsocket@protonmail.com>
+ *
+ * librestd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * librestd is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with librestd.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include "http.h"
+
+#include <list>
+#include <mutex>
+#include <functional>
+#include <unordered_map>
+
+namespace restd {
+
+class http_job;
+class scheduler;
+
+// Singleflight for route handlers: while a handler runs for a given key,
+// identical requests are parked on its flight instead of running it again,
+// without holding a worker, and all get a copy of its response once it
+// lands. Keys are built like the cache ones, see http_cache_key.
+class http_coalescer
+{
+  private:
+
+    typedef struct {
+      string                key;
+      std::list<http_job *> waiters;
+    }
+    flight_t;
+
+    std::mutex                             _mutex;
+    std::unordered_map<uint64_t, flight_t> _flights;
+    // where waiters are answered when the leader is not on a worker.
+    scheduler                             *_pool;
+    // runs the handler for waiters of a response that can't be shared.
+    std::function<void( http_job * )>      _retry;
+
+    // Only successful responses are shared.
+    static bool shareable( const http_job *leader );
+
+  public:
+
+    http_coalescer( scheduler *pool ) : _pool(pool) {}
+
+    inline void on_retry( std::function<void( http_job * )> retry ) {
+      _retry = retry;
+    }
+
+    // Takes ownership of job and returns true if the same request is in
+    // flight, otherwise job has to run the handler and land() the flight.
+    bool join( http_job *job );
+    // Hands the response of the job leading a flight to its waiters, each
+    // one is answered by a task of its own on the pool. Waiters of an error,
+    // a shed or a failed handler run the handler themselves instead.
+    void land( http_job *leader );
+};
+
+}
@@ -0,0 +1,119 @@
+/*
+ * This file is part of librestd.
+ *
+ * Copyleft of Simone Margaritelli aka evilsocket <evilsocket@protonmail.com>
+ *
+ * librestd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * librestd is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with librestd.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include "http.h"
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+namespace restd {
+
+typedef enum {
+  ENCODING_IDENTITY = 0,
+  ENCODING_GZIP,
+  ENCODING_DEFLATE
+}
+ContentEncoding;
+
+// Incremental gzip / deflate compressor, used for chunked responses.
+class http_deflater
+{
+  private:
+
+    void *_stream;
+    bool  _ok;
+
+    bool run( const char *data, size_t size, int flush, std::string& out );
+
+  public:
+
+    http_deflater( ContentEncoding encoding, int level );
+    ~http_deflater();
+
+    inline bool ok() const {
+      return _ok;
+    }
+
+    // Append to out whatever compressed data is ready.
+    bool write( const char *data, size_t size, std::string& out );
+    // Force out everything written so far, the stream stays open.
+    bool flush( std::string& out );
+    bool finish( std::string& out );
+};
+
+// Response compression policy: which responses get compressed and how,
+// plus a bounded cache of compressed bodies for routes whose body rarely
+// changes ( see http_route::compress_cached ).
+class http_compression
+{
+  private:
+
+    typedef struct {
+      uint64_t                           key;
+      // a second hash and the size of what was compressed, checked on hits.
+      size_t                             check;
+      size_t                             size;
+      std::shared_ptr<const std::string> data;
+    }
+    cache_entry_t;
+
+    typedef std::list<cache_entry_t> cache_list_t;
+
+    std::mutex                                         _mutex;
+    cache_list_t                                       _lru;
+    std::unordered_map<uint64_t, cache_list_t::iterator> _cache;
+    size_t                                             _cache_bytes;
+
+  public:
+
+    // Don't bother compressing anything smaller than this.
+    size_t         min_size;
+    // zlib compression level, 1 to 9.
+    int            level;
+    // Content-Type prefixes worth compressing.
+    vector<string> content_types;
+    // Memory bound of the compressed bodies cache.
+    size_t         cache_max_bytes;
+
+    http_compression();
+
+    // False if the library was built without zlib.
+    static bool available();
+    // Picks the encoding to use from the request Accept-Encoding header,
+    // the best quality one, and sets identity to false if the client refused
+    // an uncompressed body with identity;q=0 or *;q=0.
+    static ContentEncoding negotiate( const http_request& req, bool& identity );
+    static const char *name( ContentEncoding encoding );
+    // Adds Accept-Encoding to the Vary header of resp.
+    static void vary( http_response& resp );
+
+    // Size zero means unknown, as for streamed responses.
+    bool compressible( const http_response& resp, size_t size ) const;
+    bool compress( ContentEncoding encoding, std::string_view data, std::string& out ) const;
+    // Same as compress() but identical bodies are compressed only once.
+    std::shared_ptr<const std::string> compress_cached( ContentEncoding encoding, std::string_view data );
+};
+
+}
@@ -0,0 +1,127 @@
+/*
+ * This file is part of librestd.
+ *
+ * Copyleft of Simone Margaritelli aka evilsocket <evilsocket@protonmail.com>
+ *
+ * librestd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * librestd is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with librestd.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include "http.h"
+
+#include <new>
+#include <utility>
+#include <type_traits>
+
+namespace restd {
+
+class http_controller
+{
+  public:
+    typedef void (http_controller::*handler_t)( http_request& req, http_response& resp );
+};
+
+template <typename M>
+struct member_handler_traits;
+
+template <typename C>
+struct member_handler_traits<void (C::*)( http_request&, http_response& )> {
+  typedef C class_type;
+};
+
+template <typename C>
+struct member_handler_traits<void (C::*)( http_request&, http_response& ) const> {
+  typedef const C class_type;
+};
+
+// Binds a member function known at compile time to an object, the call
+// is direct so the compiler is free to inline the method into the thunk.
+template <auto M>
+struct member_handler {
+  typedef typename member_handler_traits<decltype(M)>::class_type class_type;
+
+  class_type *object;
+
+  inline void operator()( http_request& req, http_response& resp ) const {
+    (object->*M)( req, resp );
+  }
+};
+
+// Type erased handler: a single function pointer to a thunk that is
+// instantiated for the exact callable type. Callables up to inline_size
+// bytes live inside the object itself, bigger ones are allocated once
+// when the route is registered and never on the request path.
+class http_handler
+{
+  public:
+
+    static const size_t inline_size = 4 * sizeof(void *);
+
+  private:
+
+    typedef void (*thunk_t)( void *target, http_request& req, http_response& resp );
+    typedef void (*destroy_t)( void *target, bool on_heap );
+
+    union {
+      void *heap;
+      typename std::aligned_storage<inline_size, alignof(std::max_align_t)>::type buffer;
+    }
+    _storage;
+    bool      _on_heap;
+    thunk_t   _thunk;
+    destroy_t _destroy;
+
+    inline void *target() {
+      return _on_heap ? _storage.heap : (void *)&_storage.buffer;
+    }
+
+    template <typename F>
+    static void thunk( void *target, http_request& req, http_response& resp ) {
+      (*static_cast<F *>(target))( req, resp );
+    }
+
+    template <typename F>
+    static void destroy( void *target, bool on_heap ) {
+      if( on_heap ) {
+        delete static_cast<F *>(target);
+      } else {
+        static_cast<F *>(target)->~F();
+      }
+    }
+
+  public:
+
+    template <typename F, typename Fn = typename std::decay<F>::type>
+    http_handler( F&& fn ) : _thunk(thunk<Fn>), _destroy(destroy<Fn>) {
+      _on_heap = sizeof(Fn) > inline_size || alignof(Fn) > alignof(std::max_align_t);
+      if( _on_heap ) {
+        _storage.heap = new Fn( std::forward<F>(fn) );
+      } else {
+        new (&_storage.buffer) Fn( std::forward<F>(fn) );
+      }
+    }
+
+    http_handler( const http_handler& ) = delete;
+    http_handler& operator=( const http_handler& ) = delete;
+
+    ~http_handler() {
+      _destroy( target(), _on_heap );
+    }
+
+    inline void operator()( http_request& req, http_response& resp ) {
+      _thunk( target(), req, resp );
+    }
+};
+
+}
@@ -0,0 +1,124 @@
+/*
+ * This file is part of librestd.
+ *
+ * Copyleft of Simone Margaritelli aka evilsocket <evilsocket@protonmail.com>
+ *
+ * librestd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * librestd is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with librestd.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include "tcp_stream.h"
+#include "http.h"
+#include "http_compression.h"
+#include "http_cache.h"
+#include "http_coalescer.h"
+#include "http_priority.h"
+
+#include <atomic>
+#include <chrono>
+#include <exception>
+
+namespace restd {
+
+class http_route;
+class http_server;
+
+// A parsed request waiting to be handled, owns the client connection
+// so it can be moved across threads until the response is sent.
+class http_job
+{
+  friend class http_coalescer;
+
+  private:
+
+    // Points into a per thread buffer if the body had to be serialized.
+    std::string_view _body;
+    bool             _materialized;
+    // Key of the request in the cache, empty until computed.
+    string           _cache_key;
+    uint64_t         _cache_hash;
+    // Leading the flight of a coalesced request, see http_coalescer.
+    bool             _leader;
+    uint64_t         _flight;
+    // Runs the handler even if the same request is in flight.
+    bool             _solo;
+    // The handler threw, the response is a generic 500.
+    bool             _failed;
+    // The client accepts an uncompressed body, see http_compression::negotiate.
+    bool             _identity;
+
+    // The encoding to respond with, identity if compression is disabled.
+    ContentEncoding negotiate();
+    // The body as it will be sent, JSON bodies are serialized only once.
+    std::string_view materialize();
+    // Sets the ETag and turns the response into a 304 if the client
+    // already has it, returns true in that case.
+    bool revalidate();
+    // Sends bytes as they are, but with the current Date.
+    void send( const http_cached_t& frozen, const char *what );
+    // Caches the serialized response if the route asks for it.
+    void store( const string& serialized, ContentEncoding encoding );
+    // Serializes the response head, and the body unless it's streamed.
+    size_t serialize( string& out, ContentEncoding& encoding );
+    // Sends a chunked body while the generator produces it.
+    void stream( ContentEncoding encoding );
+    // Charges the queue it was popped from, once.
+    void charge();
+    // Serializes a compressed variant of the body, false if it's not worth it
+    // or, when forced, if it can't be done.
+    bool compress( ContentEncoding encoding, std::string& out, size_t& body_size, bool forced );
+
+  public:
+
+    static const size_t max_buffer_size = 1024 * 1024;
+
+    tcp_stream   *client;
+    http_request  request;
+    http_response response;
+    http_route       *route;
+    // NULL if compression is disabled.
+    http_compression *compression;
+    http_cache       *cache;
+    http_coalescer   *coalescer;
+    // The server the client connected to, told when the job is done so it
+    // knows when it's drained.
+    http_server      *server;
+    // Lane and client this job is queued by, see http_priority_queue.
+    Priority                   priority;
+    uint64_t                   flow;
+    // The queue this job was popped from and when, charged with the time
+    // it took from then until the response was sent.
+    http_priority_queue       *queue;
+    std::chrono::steady_clock::time_point popped;
+
+    http_job( tcp_stream *client );
+    ~http_job();
+
+    // Sends the cached response if there's one, otherwise sets route
+    // if the cache knows which one serves this request.
+    bool from_cache();
+    // Sends the prebuilt response of a constant route.
+    void respond_prebuilt();
+    // Runs the route handler, or sets a 404 if no route matched.
+    void process();
+    // Replaces the response with a 500 after an exception.
+    void fail( const char *what, const std::exception& e );
+    // Runs the coroutine of an async route, then responds and deletes the
+    // job, likely on another thread once the coroutine completes.
+    void process_async();
+    // Serializes and sends the response to the client.
+    void respond();
+};
+
+}
@@ -0,0 +1,105 @@
+/*
+ * This file is part of librestd.
+ *
+ * Copyleft of Simone Margaritelli aka evilsocket <evilsocket@protonmail.com>
+ *
+ * librestd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * librestd is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with librestd.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include "http.h"
+
+#include <tuple>
+#include <utility>
+#include <type_traits>
+
+namespace restd {
+
+// A handler running behind a middleware chain, as returned by
+// middleware_chain::wrap(): routes built from one know they are wrapped
+// ( see http_route::wrapped ).
+template <typename H>
+struct wrapped_handler {
+  H handler;
+
+  inline void operator()( http_request& req, http_response& resp ) const {
+    handler( req, resp );
+  }
+};
+
+template <typename F>
+struct is_wrapped_handler : std::false_type {};
+
+template <typename H>
+struct is_wrapped_handler<wrapped_handler<H>> : std::true_type {};
+
+// A middleware is any object that can be called as:
+//
+//   void operator()( http_request& req, http_response& resp, Next&& next ) const;
+//
+// where next() runs the rest of the chain and eventually the handler, not
+// calling it short circuits the request with whatever is in resp.
+//
+// Layers are stored by value and the chain is unrolled at compile time,
+// so the whole thing ends up in a single thunk with no virtual calls and
+// no allocations per request.
+template <typename... M>
+class middleware_chain
+{
+  private:
+
+    template <typename... N> friend class middleware_chain;
+
+    std::tuple<M...> _layers;
+
+    template <size_t I, typename H>
+    inline void invoke( http_request& req, http_response& resp, const H& handler ) const {
+      if constexpr( I == sizeof...(M) ) {
+        handler( req, resp );
+      } else {
+        std::get<I>(_layers)( req, resp, [&]() { this->invoke<I + 1>( req, resp, handler ); } );
+      }
+    }
+
+  public:
+
+    explicit middleware_chain( std::tuple<M...> layers ) : _layers( std::move(layers) ) {}
+
+    // Returns a new chain running this chain's layers first, then other's.
+    template <typename... N>
+    middleware_chain<M..., N...> then( const middleware_chain<N...>& other ) const {
+      return middleware_chain<M..., N...>( std::tuple_cat( _layers, other._layers ) );
+    }
+
+    // Returns a handler running the chain around handler, an empty chain
+    // returns handler itself.
+    template <typename H>
+    auto wrap( H&& handler ) const {
+      if constexpr( sizeof...(M) == 0 ) {
+        return std::forward<H>(handler);
+      } else {
+        auto wrapper = [chain = *this, handler = std::forward<H>(handler)]( http_request& req, http_response& resp ) {
+          chain.template invoke<0>( req, resp, handler );
+        };
+        return wrapped_handler<decltype(wrapper)>{ std::move(wrapper) };
+      }
+    }
+};
+
+template <typename... M>
+middleware_chain<typename std::decay<M>::type...> middleware( M&&... layers ) {
+  return middleware_chain<typename std::decay<M>::type...>( std::make_tuple( std::forward<M>(layers)... ) );
+}
+
+}
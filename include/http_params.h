@@ -0,0 +1,144 @@
+/*
+ * This file is part of librestd.
+ *
+ * Copyleft of Simone Margaritelli aka evilsocket <evilsocket@protonmail.com>
+ *
+ * librestd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * librestd is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with librestd.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+namespace restd {
+
+// 128 bit UUID parsed from its canonical 8-4-4-4-12 hex representation.
+struct uuid {
+  uint8_t bytes[16];
+
+  inline bool operator==( const uuid& other ) const {
+    return memcmp( bytes, other.bytes, sizeof(bytes) ) == 0;
+  }
+
+  inline bool operator!=( const uuid& other ) const {
+    return !( *this == other );
+  }
+};
+
+// A named parameter captured from the request path, value points
+// straight into http_request::path so no copy is ever made.
+struct path_param {
+  const char      *name;
+  std::string_view value;
+};
+
+// Parses a raw parameter value into T, returns false if the value
+// is not a valid representation of T or if it overflows.
+template <typename T, typename Enable = void>
+struct param_parser;
+
+template <typename T>
+struct param_parser<T, typename std::enable_if<std::is_integral<T>::value && !std::is_same<T, bool>::value>::type> {
+  static inline bool parse( std::string_view s, T& value ) {
+    const char *begin = s.data(),
+               *end   = s.data() + s.size();
+
+    auto r = std::from_chars( begin, end, value );
+    return r.ec == std::errc() && r.ptr == end && begin != end;
+  }
+};
+
+template <typename T>
+struct param_parser<T, typename std::enable_if<std::is_floating_point<T>::value>::type> {
+  static inline bool parse( std::string_view s, T& value ) {
+    const char *begin = s.data(),
+               *end   = s.data() + s.size();
+
+    auto r = std::from_chars( begin, end, value );
+    return r.ec == std::errc() && r.ptr == end && begin != end;
+  }
+};
+
+template <>
+struct param_parser<bool> {
+  static inline bool parse( std::string_view s, bool& value ) {
+    if( s == "1" || s == "true" ) {
+      value = true;
+      return true;
+    }
+    else if( s == "0" || s == "false" ) {
+      value = false;
+      return true;
+    }
+    return false;
+  }
+};
+
+template <>
+struct param_parser<std::string_view> {
+  static inline bool parse( std::string_view s, std::string_view& value ) {
+    value = s;
+    return true;
+  }
+};
+
+template <>
+struct param_parser<std::string> {
+  static inline bool parse( std::string_view s, std::string& value ) {
+    value.assign( s.data(), s.size() );
+    return true;
+  }
+};
+
+template <>
+struct param_parser<uuid> {
+  static inline bool parse( std::string_view s, uuid& value ) {
+    // xxxxxxxx-xxxx-xxxx-xxxx-xxxxxxxxxxxx
+    if( s.size() != 36 || s[8] != '-' || s[13] != '-' || s[18] != '-' || s[23] != '-' ) {
+      return false;
+    }
+
+    for( size_t i = 0, b = 0; i < s.size(); ) {
+      if( s[i] == '-' ) {
+        ++i;
+        continue;
+      }
+
+      auto r = std::from_chars( s.data() + i, s.data() + i + 2, value.bytes[b++], 16 );
+      if( r.ec != std::errc() || r.ptr != s.data() + i + 2 ) {
+        return false;
+      }
+
+      i += 2;
+    }
+
+    return true;
+  }
+};
+
+// Type erased validator used by routes to check typed parameters
+// while matching.
+typedef bool (*param_validator_t)( std::string_view s );
+
+template <typename T>
+inline bool validate_param( std::string_view s ) {
+  T value;
+  return param_parser<T>::parse( s, value );
+}
+
+}
@@ -0,0 +1,115 @@
+/*
+ * This file is part of librestd.
+ *
+ * Copyleft of Simone Margaritelli aka evilsocket <evilsocket@protonmail.com>
+ *
+ * librestd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * librestd is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with librestd.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include "http.h"
+#include "tcp_stream.h"
+
+#include <list>
+#include <mutex>
+#include <functional>
+#include <unordered_map>
+#include <chrono>
+#include <cstdint>
+
+namespace restd {
+
+class http_job;
+
+typedef enum {
+  PRIORITY_HIGH = 0,
+  PRIORITY_NORMAL,
+  PRIORITY_LOW
+}
+Priority;
+
+// Gets a parsed request, its client and the priority of the route it
+// matched, returns the priority to handle it with.
+typedef std::function<Priority( const http_request& req, tcp_stream *client, Priority priority )> http_classifier_t;
+
+// Parsed requests waiting for a worker, one lane per priority.
+//
+// Lanes are served by weighted round robin: each lane gets up to its
+// weight of requests per round before the lower ones get their turn,
+// so bulk traffic slows down under load but never starves. In strict
+// mode a lane is only served when all the higher ones are empty.
+//
+// Within a lane requests are grouped in flows, one per client, served by
+// deficit round robin: a flow is served while it has credit, the worker
+// time its requests take is charged to it and every round gives it one
+// more quantum. A client flooding the server just grows its own backlog,
+// everyone else still gets a fair share of the workers.
+class http_priority_queue
+{
+  public:
+
+    static const unsigned int n_priorities = PRIORITY_LOW + 1;
+    // Debt a flow can build up, in quanta, so one very slow request
+    // doesn't ban its client for ages.
+    static const int64_t      max_debt = 16;
+
+  private:
+
+    typedef struct {
+      std::list<http_job *> jobs;
+      // nanoseconds of worker time left in this round, can go negative.
+      int64_t               deficit;
+      // jobs popped but not charged yet.
+      unsigned int          running;
+      bool                  active;
+    }
+    flow_t;
+
+    typedef struct {
+      std::unordered_map<uint64_t, flow_t> flows;
+      // flows with jobs waiting, in round robin order.
+      std::list<uint64_t>                  active;
+    }
+    lane_t;
+
+    std::mutex   _mutex;
+    lane_t       _lanes[n_priorities];
+    unsigned int _weights[n_priorities];
+    // what's left of each lane's weight in this round.
+    unsigned int _credits[n_priorities];
+    bool         _strict;
+    int64_t      _quantum;
+
+    http_job *pop( lane_t& lane );
+
+  public:
+
+    http_priority_queue();
+
+    // Requests served per round by each lane, at least one.
+    void weights( unsigned int high, unsigned int normal, unsigned int low );
+    // Always serves the highest priority lane first.
+    void strict( bool enabled = true );
+    // Worker time each client gets per round.
+    void quantum( std::chrono::microseconds quantum );
+
+    // Queues job in the flow of the client it's keyed by, see http_job::flow.
+    void push( http_job *job );
+    // The next job to handle, NULL if there's none.
+    http_job *pop();
+    // Charges the worker time used by a job that pop() returned.
+    void charge( Priority priority, uint64_t flow, std::chrono::nanoseconds used );
+};
+
+}
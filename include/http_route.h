@@ -19,37 +19,266 @@
 #pragma once
 
 #include "http.h"
+#include "http_handler.h"
+#include "http_middleware.h"
+#include "http_cache.h"
+#include "http_priority.h"
+#include "async.h"
 
 #include <regex>
+#include <stdexcept>
+#include <list>
+#include <unordered_map>
 
 namespace restd {
 
-class http_controller 
+class http_bulkhead;
+
+#if defined(__cpp_impl_coroutine)
+// Handlers returning async<> are run as coroutines, see http_route::is_async().
+typedef std::function<async<>( http_request& req, http_response& resp )> http_async_handler_t;
+
+template <typename F>
+struct is_async_handler : std::is_same<typename std::invoke_result<F&, http_request&, http_response&>::type, async<>> {};
+#endif
+
+class http_route 
 {
+  private:
+
+    bool                      is_re;
+    std::regex                re;
+    vector<string>            names;
+    vector<param_validator_t> validators;
+    size_t                    re_expected;
+
+    void compile();
+
+#if defined(__cpp_impl_coroutine)
+    template <typename F>
+    static http_async_handler_t async_of( const F& handler ) {
+      if constexpr( is_async_handler<F>::value ) {
+        return http_async_handler_t( handler );
+      } else {
+        return http_async_handler_t();
+      }
+    }
+
+    // Coroutines are also run to completion when a plain handler is
+    // needed, by coalesced or bulkhead limited requests.
+    template <typename F, typename Fn = typename std::decay<F>::type>
+    auto sync_of( F&& handler ) {
+      if constexpr( is_async_handler<Fn>::value ) {
+        return [this]( http_request& req, http_response& resp ) {
+          block_on( async_handler( req, resp ) );
+        };
+      } else {
+        return std::forward<F>(handler);
+      }
+    }
+#endif
+
   public:
-    typedef void (http_controller::*handler_t)( http_request& req, http_response& resp );
+
+    unsigned int   methods;
+    string         path;
+#if defined(__cpp_impl_coroutine)
+    // Set if the handler is a coroutine.
+    http_async_handler_t async_handler;
+#endif
+    http_handler   handler;
+    http_bulkhead *bulkhead;
+    bool           cache_compressed;
+    bool           with_etag;
+    // Seconds a response is served from the cache, 0 if not cached.
+    unsigned int   cache_ttl;
+    http_cache_key cache_key;
+    bool           coalesced;
+    // Serialized once by content encoding, see http_server::constant().
+    http_cached_t  prebuilt[3];
+    // The compressed variants are worth sending to whoever accepts them.
+    bool           prebuilt_preferred;
+    // The handler runs behind a middleware chain.
+    bool           wrapped;
+    // Lane of this route's requests if the server prioritizes them.
+    Priority       priority;
+    // Handled on the blocking pool instead of the workers.
+    bool           offloaded;
+    // Path parameters are also copied into req.parameters.
+    bool           copy_params;
+
+    template <typename F>
+    http_route( string path, F&& handler, unsigned int methods = ANY ) :
+      is_re(false),
+      re_expected(0),
+      methods(methods),
+      path(path),
+#if defined(__cpp_impl_coroutine)
+      async_handler( async_of( handler ) ),
+      handler( sync_of( std::forward<F>(handler) ) ),
+#else
+      handler( std::forward<F>(handler) ),
+#endif
+      bulkhead(NULL),
+      cache_compressed(false),
+      with_etag(false),
+      cache_ttl(0),
+      coalesced(false),
+      prebuilt_preferred(false),
+      wrapped( is_wrapped_handler<typename std::decay<F>::type>::value ),
+      priority(PRIORITY_NORMAL),
+      offloaded(false),
+      copy_params(true) {
+      compile();
+    }
+
+    // Path parameters are only exposed as views into the path, see
+    // http_request::param<T>(), and routing doesn't allocate: handlers
+    // reading them from req.parameters won't find them anymore.
+    inline http_route *param_views() {
+      copy_params = false;
+      return this;
+    }
+
+    // Runs this route's requests through bulkhead.
+    inline http_route *limit( http_bulkhead *bulkhead ) {
+      if( bulkhead && offloaded ) {
+        throw std::invalid_argument( "Blocking routes can't be limited by a bulkhead." );
+      }
+      this->bulkhead = bulkhead;
+      return this;
+    }
+
+    // The body of this route rarely changes, keep its compressed variants around.
+    inline http_route *compress_cached() {
+      cache_compressed = true;
+      return this;
+    }
+
+    // Tags GET responses with an ETag, either the one set by the handler
+    // or a hash of the body, and answers If-None-Match hits with a 304.
+    inline http_route *etag() {
+      with_etag = true;
+      return this;
+    }
+
+    // Serves GET responses from the server cache for ttl seconds, requests
+    // only differing by what's not in key get the same bytes.
+    //
+    // Hits are served before routing, so they would skip the middleware:
+    // routes whose handler is wrapped by a chain can't be cached.
+    inline http_route *cache( unsigned int ttl, http_cache_key key = http_cache_key() ) {
+      if( wrapped ) {
+        throw std::invalid_argument( "Routes behind middleware can't be cached." );
+      }
+      cache_ttl = ttl;
+      cache_key = std::move(key);
+      return this;
+    }
+
+    // Concurrent GET requests with the same cache key share a single run
+    // of the handler, see http_coalescer. Waiters skip the middleware, like
+    // cache hits.
+    inline http_route *coalesce() {
+      if( wrapped ) {
+        throw std::invalid_argument( "Routes behind middleware can't be coalesced." );
+      }
+      else if( offloaded ) {
+        throw std::invalid_argument( "Blocking routes can't be coalesced." );
+      }
+      coalesced = true;
+      return this;
+    }
+
+    inline http_route *coalesce( http_cache_key key ) {
+      cache_key = std::move(key);
+      return coalesce();
+    }
+
+    // Handles this route's requests in the priority lane, see http_server::prioritize().
+    inline http_route *prioritize( Priority priority ) {
+      this->priority = priority;
+      return this;
+    }
+
+    // The handler blocks on disk, processes or slow clients: its requests are
+    // handed to the blocking pool once parsed so the workers keep serving,
+    // see blocking_pool. Coroutines should rather co_await offload().
+    //
+    // Bulkhead limited and coalesced requests get handed over again once
+    // admitted, on top of this they would take two hops: routes can have
+    // either one or the other.
+    inline http_route *blocking() {
+      if( bulkhead ) {
+        throw std::invalid_argument( "Routes limited by a bulkhead can't be blocking." );
+      }
+      else if( coalesced ) {
+        throw std::invalid_argument( "Coalesced routes can't be blocking." );
+      }
+      offloaded = true;
+      return this;
+    }
+
+    // The handler is a coroutine, its requests don't hold a worker while
+    // it's suspended.
+    inline bool is_async() const {
+#if defined(__cpp_impl_coroutine)
+      return (bool)async_handler;
+#else
+      return false;
+#endif
+    }
+
+    inline bool is_constant() const {
+      return (bool)prebuilt[ENCODING_IDENTITY].bytes;
+    }
+
+    bool matches( http_request& req );
+
+    inline void call( http_request& req, http_response& resp ) {
+      handler( req, resp );
+    }
 };
 
-class http_route 
+typedef std::list<http_route *> routes_t;
+
+// Routes scoped to a single Host, keyed by the hash of its name, names
+// colliding on the same hash share its bucket.
+typedef struct {
+  string   host;
+  routes_t routes;
+}
+vhost_t;
+
+struct vhost_hasher {
+  inline size_t operator()( uint64_t h ) const {
+    return (size_t)h;
+  }
+};
+
+typedef std::unordered_multimap<uint64_t, vhost_t, vhost_hasher> vhosts_t;
+
+// Owns every route and finds the one handling a request: routes bound to
+// the request Host are looked up first by hash, then the global ones.
+class http_router
 {
   private:
 
-    bool           is_re;
-    std::regex     re;
-    vector<string> names;
-    size_t         re_expected;
+    routes_t _routes;
+    vhosts_t _vhosts;
+
+    http_route *match( routes_t& routes, http_request& req );
 
   public:
 
-    unsigned int               methods;
-    string                     path;
-    http_controller           *controller;
-    http_controller::handler_t handler;
+    ~http_router();
 
-    http_route( string path, http_controller *controller, http_controller::handler_t handler, unsigned int methods = ANY );
+    // Hashes host ignoring case and port, len is set to the size of the name.
+    static uint64_t host_hash( const string& host, size_t& len );
 
-    bool matches( http_request& req );
-    void call( http_request& req, http_response& resp );
+    // Takes ownership of route, an empty host makes it global.
+    http_route *add( const string& host, http_route *route );
+    http_route *match( http_request& req );
 };
 
 }
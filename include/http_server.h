@@ -18,53 +18,270 @@
 */
 #pragma once
 
-#include "work_queue.hpp"
-#include "consumer.hpp"
+#include "scheduler.h"
+#include "blocking.h"
+#include "affinity.h"
 #include "tcp_server.h"
 #include "http.h"
 #include "http_route.h"
+#include "http_middleware.h"
+#include "http_bulkhead.h"
+#include "http_job.h"
+#include "http_compression.h"
+#include "http_cache.h"
+#include "http_coalescer.h"
+#include "http_priority.h"
+#include "codel.h"
+#include "log.h"
+
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <csignal>
 
 namespace restd {
 
-typedef list<http_route *> routes_t;
+class http_server;
+template <typename Chain> class http_route_group;
 
-class http_consumer : public consumer<tcp_stream> 
+// Reads, routes and answers requests on the scheduler workers.
+class http_consumer
 {
+  friend class http_server;
+
   private:
 
-    routes_t *_routes;
+    http_server *_server;
 
-    void route( http_request& request, http_response& response );
+    bool read( tcp_stream *client, http_request& request, http_response& response );
+    // Runs the handler of a routed job, takes ownership of it.
+    void execute( http_job *job );
+    // Same as execute(), on the calling thread.
+    void run( http_job *job );
 
   public:
 
-    http_consumer(work_queue<tcp_stream *>& queue, routes_t *routes) : consumer(queue), _routes(routes) {}
+    http_consumer(http_server *server) : _server(server) {}
    
-    virtual void consume( tcp_stream *client );
+    // Takes ownership of client.
+    void consume( tcp_stream *client );
+    // Handles the next job waiting in the priority lanes.
+    void dispatch();
 };
 
 class http_server 
 {
+  friend class http_consumer;
+  friend class http_job;
+
   private:
 
    string                   _address;
    unsigned short           _port;
    tcp_server              *_server;
    unsigned int             _threads;
-   work_queue<tcp_stream *> _queue;
-   list<http_consumer *>    _consumers;
-   routes_t                 _routes;
+   scheduler                _scheduler;
+   http_consumer            _consumer;
+   // accepted connections not done yet.
+   std::atomic<unsigned int> _pending;
+   std::atomic<bool>         _stopping;
+   // signalled by the last job done while draining.
+   std::mutex                _drain_mutex;
+   std::condition_variable   _drained;
+   affinity::cpu_list_t      _acceptor_cpus;
+   affinity::cpu_list_t      _worker_cpus;
+   http_router              _router;
+   list<http_bulkhead *>    _bulkheads;
+   bool                     _compress;
+   http_compression         _compression;
+   http_cache               _cache;
+   http_coalescer           _coalescer;
+   bool                     _shedding;
+   codel                    _shedder;
+   http_cached_t            _shed_response;
+   bool                     _prioritized;
+   bool                     _fair;
+   string                   _fair_header;
+   http_classifier_t        _classifier;
+   http_priority_queue      _priorities;
+
+   // Key of the client a request is fair queued by.
+   uint64_t flow_of( const http_request& req, tcp_stream *client );
+   // Called by each job once done.
+   void release();
+   // Waits up to drain_timeout for pending requests, then stops the workers.
+   void drain();
+   // Gives back the signals of stop_on() if they still point to us.
+   void restore_signals();
 
   public:
 
+   // Connections accepted and dispatched at once during a burst.
+   static const size_t max_accept_batch = 64;
+
    http_server( string address, unsigned short port, unsigned int threads );
    virtual ~http_server();
 
-   void route( string path, http_controller *controller, http_controller::handler_t handler, unsigned int methods = ANY );
+   // Registers any callable with a void( http_request&, http_response& ) signature.
+   template <typename F>
+   http_route *route( string path, F&& handler, unsigned int methods = ANY ) {
+     return add( "", new http_route( path, std::forward<F>(handler), methods ) );
+   }
+
+   // Registers a member function of object, route<&my_controller::index>( "/", &ctrl ).
+   template <auto M>
+   http_route *route( string path, typename member_handler<M>::class_type *object, unsigned int methods = ANY ) {
+     return route( path, member_handler<M>{ object }, methods );
+   }
+
+   http_route *route( string path, http_controller *controller, http_controller::handler_t handler, unsigned int methods = ANY );
+
+   // Serves response for path as it is now: it's serialized once, plus its
+   // compressed variants if compress() was already called, and each request
+   // just gets the same bytes.
+   http_route *constant( string path, const http_response& response, unsigned int methods = GET );
+
+   // Takes ownership of route, an empty host makes it valid for any Host.
+   http_route *add( const string& host, http_route *route );
+
+   // Enables gzip / deflate compression of responses, see compression() to tune it.
+   void compress( bool enabled = true );
+
+   inline http_compression& compression() {
+     return _compression;
+   }
+
+   // Responses of routes enabling cache(), see http_route::cache().
+   inline http_cache& cache() {
+     return _cache;
+   }
+
+   // Answers 503 with Retry-After right away to connections that have been
+   // waiting for a worker too long, see codel. Better to fail some requests
+   // fast than to have all of them time out once the server falls behind.
+   void shed_load( unsigned int target_ms = 20, unsigned int interval_ms = 100, unsigned int retry_after = 1 );
+
+   // Requests answered with a 503 by shed_load().
+   inline uint64_t shed() const {
+     return _shedder.shed();
+   }
+
+   // Parsed requests wait in priority lanes instead of being handled in
+   // arrival order, so health checks or admin calls skip ahead of bulk
+   // ones when workers are saturated. The lane is the route priority, see
+   // http_route::prioritize(), unless classifier says otherwise.
+   void prioritize( http_classifier_t classifier = http_classifier_t() );
+
+   // Shares the workers among clients when they're saturated, so one
+   // flooding the server only slows itself down, see http_priority_queue.
+   // Clients are told apart by the value of header, an API key for
+   // instance, or by their address if it's empty or missing.
+   void fair_queue( const string& header = "", std::chrono::microseconds quantum = std::chrono::milliseconds(1) );
+
+   // Weights of the priority lanes and fair queuing quantum.
+   inline http_priority_queue& priorities() {
+     return _priorities;
+   }
+
+   // Creates a concurrency limit to be shared by one or more routes, see http_bulkhead.
+   http_bulkhead *bulkhead( string name, unsigned int max_concurrent, unsigned int max_queued = 0, unsigned int threads = 0 );
+
+   // Returns a group of routes sharing a path prefix and a middleware chain.
+   template <typename... M>
+   http_route_group<middleware_chain<typename std::decay<M>::type...>> group( string prefix, M&&... layers );
+
+   // Same as group() with no prefix, server.with( auth() ).route( ... ) .
+   template <typename... M>
+   http_route_group<middleware_chain<typename std::decay<M>::type...>> with( M&&... layers ) {
+     return group( "", std::forward<M>(layers)... );
+   }
 
+   // Returns a group of routes only matching requests for this Host,
+   // they're checked before the global ones.
+   template <typename... M>
+   http_route_group<middleware_chain<typename std::decay<M>::type...>> host( string name, M&&... layers );
+
+   // Pins the thread calling start() to cpus.
+   void pin_acceptor( const affinity::cpu_list_t& cpus );
+   // Pins worker i to cpus[ i % cpus.size() ]. Workers are pinned before
+   // they allocate anything, so with the kernel's first touch policy their
+   // per thread state and buffers end up on the NUMA node of their CPU.
+   void pin_workers( const affinity::cpu_list_t& cpus );
+
+   // Seconds stop() waits for in flight and queued requests, the workers
+   // are stopped afterwards anyway: what's running is waited for, what's
+   // still queued runs, but nothing new is accepted.
+   unsigned int drain_timeout;
+
+   // Accepts and serves requests until stop() is called, then drains them.
+   // If the timeout expires first it returns anyway and the destructor
+   // will wait for the leftovers.
    void start();
+   // Stops accepting and makes start() drain and return, it's safe to call
+   // from any thread or from a signal handler.
+   void stop();
+   // Calls stop() when signo is received, SIGTERM by default.
+   void stop_on( int signo = SIGTERM );
+};
+
+template <typename Chain>
+class http_route_group
+{
+  private:
+
+    http_server   *_server;
+    string         _host;
+    string         _prefix;
+    Chain          _chain;
+    http_bulkhead *_bulkhead;
+
+  public:
+
+    http_route_group( http_server *server, string host, string prefix, Chain chain, http_bulkhead *bulkhead = NULL ) :
+      _server(server), _host(host), _prefix(prefix), _chain(chain), _bulkhead(bulkhead) {}
+
+    // Every route registered from now on will share bulkhead.
+    http_route_group& limit( http_bulkhead *bulkhead ) {
+      _bulkhead = bulkhead;
+      return *this;
+    }
+
+    template <typename F>
+    http_route *route( string path, F&& handler, unsigned int methods = ANY ) {
+#if defined(__cpp_impl_coroutine)
+      static_assert( !is_async_handler<typename std::decay<F>::type>::value, "Middleware chains can only wrap plain handlers." );
+#endif
+      return _server->add( _host, new http_route( _prefix + path, _chain.wrap( std::forward<F>(handler) ), methods ) )->limit( _bulkhead );
+    }
+
+    template <auto M>
+    http_route *route( string path, typename member_handler<M>::class_type *object, unsigned int methods = ANY ) {
+      return route( path, member_handler<M>{ object }, methods );
+    }
+
+    // Nested groups run the outer layers first.
+    template <typename... M>
+    auto group( string prefix, M&&... layers ) const {
+      auto chain = _chain.then( middleware( std::forward<M>(layers)... ) );
+      return http_route_group<decltype(chain)>( _server, _host, _prefix + prefix, chain, _bulkhead );
+    }
+
+    template <typename... M>
+    auto with( M&&... layers ) const {
+      return group( "", std::forward<M>(layers)... );
+    }
 };
 
+template <typename... M>
+http_route_group<middleware_chain<typename std::decay<M>::type...>> http_server::group( string prefix, M&&... layers ) {
+  return http_route_group<middleware_chain<typename std::decay<M>::type...>>( this, "", prefix, middleware( std::forward<M>(layers)... ) );
+}
+
+template <typename... M>
+http_route_group<middleware_chain<typename std::decay<M>::type...>> http_server::host( string name, M&&... layers ) {
+  return http_route_group<middleware_chain<typename std::decay<M>::type...>>( this, name, "", middleware( std::forward<M>(layers)... ) );
+}
+
 #define RESTD_ROUTE( SERVER, METHOD, PATH, CONTROLLER, HANDLER ) \
-  (SERVER).route( (PATH), &(CONTROLLER), (restd::http_controller::handler_t)&HANDLER, (METHOD) )
+  (SERVER).route<&HANDLER>( (PATH), &(CONTROLLER), (METHOD) )
 }
@@ -0,0 +1,78 @@
+/*
+ * This file is part of librestd.
+ *
+ * Copyleft of Simone Margaritelli aka evilsocket <evilsocket@protonmail.com>
+ *
+ * librestd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * librestd is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with librestd.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include "tcp_stream.h"
+
+#include <set>
+#include <string>
+#include <string_view>
+
+namespace restd {
+
+class http_sse_loop;
+
+// A Server-Sent Events stream many clients can subscribe to. Once a
+// handler subscribes a client with http_response::subscribe() the worker
+// is released and the connection is parked in a single epoll loop shared
+// by every channel, events can then be published from any thread.
+//
+// Writes never block: what the socket doesn't take is buffered and sent
+// when it's writable again, subscribers falling more than max_pending
+// bytes behind are dropped. Idle channels get a comment line every
+// heartbeat seconds so proxies don't time them out.
+class http_sse_channel
+{
+  friend class http_sse_loop;
+
+  private:
+
+    string        _name;
+    // descriptors of the subscribers, guarded by the loop.
+    std::set<int> _subscribers;
+
+  public:
+
+    static const size_t       max_pending = 1024 * 1024;
+    static const unsigned int heartbeat = 15;
+
+    http_sse_channel( string name );
+    ~http_sse_channel();
+
+    http_sse_channel( const http_sse_channel& ) = delete;
+    http_sse_channel& operator=( const http_sse_channel& ) = delete;
+
+    inline const string& name() const {
+      return _name;
+    }
+
+    // Takes ownership of client, the response headers must be sent already.
+    // owner tags the subscriber, usually the server it came from.
+    void subscribe( tcp_stream *client, const void *owner = NULL );
+    // Sends an event to every subscriber, multi line data is split in
+    // multiple data: fields. Empty event and id are omitted.
+    void publish( std::string_view data, std::string_view event = "", std::string_view id = "" );
+    // Number of connected subscribers.
+    size_t size();
+
+    // Disconnects the subscribers of every channel subscribed by owner.
+    static void close_all( const void *owner );
+};
+
+}
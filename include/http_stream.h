@@ -0,0 +1,78 @@
+/*
+ * This file is part of librestd.
+ *
+ * Copyleft of Simone Margaritelli aka evilsocket <evilsocket@protonmail.com>
+ *
+ * librestd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * librestd is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with librestd.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include "tcp_stream.h"
+#include "http_compression.h"
+
+#include <string>
+#include <string_view>
+
+namespace restd {
+
+// Writes a response body as Transfer-Encoding: chunked, data is buffered
+// and sent one chunk at a time with blocking writes, so a slow client
+// slows down the generator instead of making us buffer the whole body.
+class http_stream_writer
+{
+  private:
+
+    // room for the hex size and its CRLF in front of each chunk.
+    static const size_t header_size = 18;
+
+    tcp_stream    *_client;
+    http_deflater *_deflater;
+    std::string    _buffer;
+    size_t         _sent;
+    bool           _failed;
+
+    bool send( const char *data, size_t size );
+    bool send_chunk();
+
+  public:
+
+    static const size_t chunk_size = 16 * 1024;
+
+    // With an encoding other than identity the body is compressed on the fly.
+    http_stream_writer( tcp_stream *client, ContentEncoding encoding = ENCODING_IDENTITY, int level = 6 );
+    ~http_stream_writer();
+
+    bool write( const char *data, size_t size );
+
+    inline bool write( std::string_view data ) {
+      return write( data.data(), data.size() );
+    }
+
+    // Sends whatever is buffered as a chunk.
+    bool flush();
+    // Flushes and sends the last, empty chunk.
+    bool finish();
+
+    // False once the client went away, generators should stop.
+    inline bool ok() const {
+      return !_failed;
+    }
+
+    // Body bytes sent so far, framing excluded, after compression.
+    inline size_t sent() const {
+      return _sent;
+    }
+};
+
+}
@@ -1631,7 +1631,7 @@ class basic_json
             alloc.deallocate(object, 1);
         };
         std::unique_ptr<T, decltype(deleter)> object(alloc.allocate(1), deleter);
-        alloc.construct(object.get(), std::forward<Args>(args)...);
+        std::allocator_traits<decltype(alloc)>::construct(alloc, object.get(), std::forward<Args>(args)...);
         assert(object != nullptr);
         return object.release();
     }
@@ -2581,7 +2581,7 @@ class basic_json
             case value_t::object:
             {
                 AllocatorType<object_t> alloc;
-                alloc.destroy(m_value.object);
+                std::allocator_traits<decltype(alloc)>::destroy(alloc, m_value.object);
                 alloc.deallocate(m_value.object, 1);
                 break;
             }
@@ -2589,7 +2589,7 @@ class basic_json
             case value_t::array:
             {
                 AllocatorType<array_t> alloc;
-                alloc.destroy(m_value.array);
+                std::allocator_traits<decltype(alloc)>::destroy(alloc, m_value.array);
                 alloc.deallocate(m_value.array, 1);
                 break;
             }
@@ -2597,7 +2597,7 @@ class basic_json
             case value_t::string:
             {
                 AllocatorType<string_t> alloc;
-                alloc.destroy(m_value.string);
+                std::allocator_traits<decltype(alloc)>::destroy(alloc, m_value.string);
                 alloc.deallocate(m_value.string, 1);
                 break;
             }
@@ -4324,7 +4324,7 @@ class basic_json
                 if (is_string())
                 {
                     AllocatorType<string_t> alloc;
-                    alloc.destroy(m_value.string);
+                    std::allocator_traits<decltype(alloc)>::destroy(alloc, m_value.string);
                     alloc.deallocate(m_value.string, 1);
                     m_value.string = nullptr;
                 }
@@ -4431,7 +4431,7 @@ class basic_json
                 if (is_string())
                 {
                     AllocatorType<string_t> alloc;
-                    alloc.destroy(m_value.string);
+                    std::allocator_traits<decltype(alloc)>::destroy(alloc, m_value.string);
                     alloc.deallocate(m_value.string, 1);
                     m_value.string = nullptr;
                 }
@@ -0,0 +1,82 @@
+/*
+ * This file is part of librestd.
+ *
+ * Copyleft of Simone Margaritelli aka evilsocket <evilsocket@protonmail.com>
+ *
+ * librestd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * librestd is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with librestd.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include "json.hpp"
+
+#include <string>
+#include <string_view>
+#include <cstdint>
+#include <vector>
+
+namespace restd {
+
+// SAX style writer producing compact JSON straight into a buffer, used to
+// serialize response bodies without building intermediate strings:
+//
+//   w.begin_object().key("id").value(42).key("tags").begin_array().value("a").end_array().end_object();
+//
+// It can also serialize a whole nlohmann::json tree with value(j).
+class json_writer
+{
+  private:
+
+    // levels tracked without allocating.
+    static const unsigned int inline_depth = 64;
+
+    std::string&      _out;
+    unsigned int      _depth;
+    // one bit per nesting level, set once the level has an element.
+    uint64_t          _has_elements;
+    // same for levels past inline_depth, there's no nesting limit.
+    std::vector<bool> _deep_elements;
+    bool              _after_key;
+
+    // Marks the current level as having an element, returns if it had one already.
+    bool mark();
+    void separate();
+    void open( char c );
+    void close( char c );
+    void string( const char *s, size_t size );
+
+  public:
+
+    json_writer( std::string& out );
+
+    json_writer& begin_object();
+    json_writer& end_object();
+    json_writer& begin_array();
+    json_writer& end_array();
+
+    json_writer& key( std::string_view k );
+
+    json_writer& null();
+    json_writer& value( bool b );
+    json_writer& value( int v );
+    json_writer& value( unsigned int v );
+    json_writer& value( int64_t v );
+    json_writer& value( uint64_t v );
+    json_writer& value( double v );
+    json_writer& value( const char *s );
+    json_writer& value( std::string_view s );
+    json_writer& value( const std::string& s );
+    json_writer& value( const nlohmann::json& j );
+};
+
+}
@@ -19,5 +19,7 @@
 #pragma once
 
 #include "http_server.h"
+#include "http_stream.h"
+#include "http_sse.h"
 #include "crash_manager.h"
 #include "log.h"
@@ -0,0 +1,195 @@
+/*
+ * This file is part of librestd.
+ *
+ * Copyleft of Simone Margaritelli aka evilsocket <evilsocket@protonmail.com>
+ *
+ * librestd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * librestd is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with librestd.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include <deque>
+#include <vector>
+#include <mutex>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <functional>
+#include <condition_variable>
+
+namespace restd {
+
+typedef std::function<void()> task_t;
+// Called on each worker thread, with its index, before it runs anything.
+typedef std::function<void( unsigned int )> worker_init_t;
+
+class latch;
+
+// Work stealing thread pool: every worker has its own deques and only
+// touches the others when it runs out of work, so there's no shared
+// queue everybody contends on.
+//
+// Tasks submitted from outside (accepted connections) are spread round
+// robin across the workers' inboxes and run in order, tasks spawned by a
+// worker land on its own stack and run last in first out, while their
+// data is still in cache. Idle workers steal the oldest work of the
+// others before going to sleep. Deferred tasks only run once there's
+// nothing else to do.
+class scheduler
+{
+  friend class latch;
+
+  private:
+
+    typedef struct alignas(64) {
+      std::mutex         mutex;
+      std::deque<task_t> inbox;
+      std::deque<task_t> spawned;
+      std::deque<task_t> deferred;
+    }
+    worker_t;
+
+    // each worker allocates its own state, after init ran, so it's on the
+    // NUMA node the worker is pinned to.
+    std::vector<worker_t *>    _workers;
+    std::vector<std::thread>   _threads;
+    worker_init_t              _init;
+    unsigned int               _ready;
+    std::atomic<unsigned>    _next;
+    std::atomic<unsigned>    _sleepers;
+    // workers waiting on a latch.
+    std::atomic<unsigned>    _blocked;
+    bool                     _running;
+    std::mutex               _mutex;
+    std::condition_variable  _wakeup;
+
+    void run( unsigned int index );
+    bool pop( worker_t *self, task_t& task );
+    bool steal( worker_t *self, task_t& task );
+    void push( worker_t *worker, task_t&& task, std::deque<task_t> worker_t::*queue );
+    void notify( size_t n );
+    // Runs queued tasks on the calling worker until done is set.
+    void help( const latch& done );
+
+  public:
+
+    scheduler( unsigned int threads );
+    ~scheduler();
+
+    scheduler( const scheduler& ) = delete;
+    scheduler& operator=( const scheduler& ) = delete;
+
+    inline size_t size() const {
+      return _workers.size();
+    }
+
+    inline void on_worker_start( worker_init_t init ) {
+      _init = init;
+    }
+
+    // Returns once every worker is ready to take tasks.
+    void start();
+    // Runs what's left, then joins the workers.
+    void stop();
+
+    void submit( task_t task );
+    // Spreads n tasks across the workers locking each of them once and
+    // waking up as many sleepers as needed with a single notification.
+    void submit_many( task_t *tasks, size_t n );
+    // Same as submit(), but task waits until the worker's other queues are
+    // empty, so what's just been accepted gets a chance to go first.
+    void defer( task_t task );
+
+    // The scheduler the calling thread is a worker of, NULL if none.
+    static scheduler *current();
+    // Queues task on the calling worker, returns false if the calling
+    // thread is not a worker of any scheduler.
+    static bool spawn_local( task_t& task );
+    // Runs one queued task of the calling worker, or one stolen from its
+    // siblings, returns false if there was nothing to do.
+    static bool run_one();
+};
+
+// One shot flag a thread sleeps on until another one sets it. A worker
+// waiting on it counts as blocked, and the last one of a pool to block
+// keeps running queued tasks instead of sleeping, so whatever it waits for
+// can't starve for lack of a worker. A task run that way which blocks in
+// turn just sleeps, helpers don't nest.
+class latch
+{
+  private:
+
+    static const unsigned spin_count = 64;
+
+    std::mutex               _mutex;
+    std::condition_variable  _cond;
+    std::atomic<bool>        _set;
+    // pool of a waiter running its tasks, woken up too.
+    std::atomic<scheduler *> _pool;
+
+  public:
+
+    latch() : _set(false), _pool(NULL) {}
+
+    latch( const latch& ) = delete;
+    latch& operator=( const latch& ) = delete;
+
+    inline bool is_set() const {
+      return _set.load();
+    }
+
+    void set();
+    // Returns once set() was called and is done with us, the latch can be
+    // destroyed right away.
+    void wait();
+};
+
+// Runs task on the current worker's own deque, where it's likely to
+// find its data still in cache. Outside of a worker it runs right away.
+void spawn( task_t task );
+
+// Fans out tasks and waits for all of them. The tasks are queued on the
+// group and the workers' deques only get a handle to claim the next one,
+// so the waiting worker runs what nobody took yet, its own tasks and not
+// unrelated ones, then sleeps until the last one running elsewhere is done.
+class task_group
+{
+  private:
+
+    typedef struct {
+      std::mutex               mutex;
+      std::deque<task_t>       tasks;
+      std::atomic<unsigned>    pending;
+      // set by the last task to finish.
+      std::shared_ptr<latch>   waiter;
+    }
+    state_t;
+
+    // shared with the handles, which can outlive the group.
+    std::shared_ptr<state_t> _state;
+
+    // Runs the next task nobody claimed yet, false if there's none.
+    static bool run_next( state_t& state );
+
+  public:
+
+    task_group();
+    ~task_group() {
+      wait();
+    }
+
+    void run( task_t task );
+    void wait();
+};
+
+}
@@ -21,6 +21,7 @@
 // string all the things!
 #include <string>
 #include <cstring>
+#include <cstdint>
 
 namespace restd {
 namespace strings {
@@ -34,6 +35,22 @@ void replace(std::string& subject, const std::string& search, const std::string&
 
 std::string urldecode( const char *src );
 
+// 64 bit FNV-1a, fast and good enough for lookup tables.
+static const uint64_t fnv_offset = 0xcbf29ce484222325ULL;
+static const uint64_t fnv_prime  = 0x100000001b3ULL;
+
+inline uint64_t hash( const char *data, size_t size, uint64_t h = fnv_offset ) {
+  for( size_t i = 0; i < size; ++i ) {
+    h ^= (unsigned char)data[i];
+    h *= fnv_prime;
+  }
+  return h;
+}
+
+inline uint64_t hash( const std::string& s, uint64_t h = fnv_offset ) {
+  return hash( s.c_str(), s.size(), h );
+}
+
 
 template <char SEP>
 class char_iterator {
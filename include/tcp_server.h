@@ -32,6 +32,8 @@ class tcp_server
     string _address;
     bool   _listening;
     bool   _is_unix;
+    // makes accept_many() return early, see interrupt().
+    int    _wakeup;
 
     tcp_server() {}
 
@@ -42,7 +44,18 @@ class tcp_server
 
     bool        start();
     tcp_stream* accept();
+    // Waits for a connection, then takes every other pending one up to
+    // max without blocking, returns how many. Errors other than the
+    // listener going away are retried with a backoff, see listening().
+    size_t      accept_many( tcp_stream **clients, size_t max );
     void        stop();
+    // False once stopped, or if the listening socket became unusable.
+    inline bool listening() const {
+      return _listening;
+    }
+    // Makes a pending or the next accept return nothing, can be called
+    // from a signal handler.
+    void        interrupt();
 };
 
 }
@@ -20,7 +20,9 @@
 
 #include <unistd.h>
 #include <netinet/in.h>
+#include <sys/uio.h>
 #include <string>
+#include <chrono>
 
 using std::string;
 
@@ -36,6 +38,7 @@ class tcp_stream
     int     _sd;
     string  _peer_address;
     int     _peer_port;
+    std::chrono::steady_clock::time_point _accepted_at;
 
     bool wait_readable(int timeout);
 
@@ -47,11 +50,25 @@ class tcp_stream
     ~tcp_stream();
 
     ssize_t send(const unsigned char* buffer, size_t len);
+    // Gathers count buffers in a single write where possible.
+    ssize_t send(const struct iovec* iov, int count);
     ssize_t receive(unsigned char* buffer, size_t len, int timeout=0);
     ssize_t read_until(unsigned char until, string& line, int timeout);
+    // Stops writing and drops whatever the peer already sent, so that closing
+    // the socket doesn't reset the connection before it reads our response.
+    void discard();
 
     string peer_address();
     int    peer_port();
+
+    inline int descriptor() const {
+      return _sd;
+    }
+
+    // When the connection was accepted, to tell how long it's been queued.
+    inline std::chrono::steady_clock::time_point accepted_at() const {
+      return _accepted_at;
+    }
 };
 
 }
@@ -18,50 +18,322 @@
 */
 #pragma once
 
-#include <list>
-#include <condition_variable>
-#include <mutex>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <stdexcept>
+#include <climits>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
 #include <stdio.h>
  
 using namespace std;
  
 namespace restd {
 
+// Bounded multi producer multi consumer queue, a ring of cells each with
+// its own sequence number (Dmitry Vyukov's design) so producers and
+// consumers only contend on a single atomic increment of their own index
+// and never on a lock.
+//
+// When the ring is empty (or full) threads spin for a little while, then
+// park on a futex, producers only make the wake up syscall if somebody is
+// sleeping and only wake as many as they have items for.
 template <typename T> 
 class work_queue
 { 
   protected:
 
-    list<T>            _queue;
-    mutex              _mutex;
-    condition_variable _avail;
+    static const size_t   cache_line = 64;
+    static const unsigned spin_count = 128;
+
+    // a cell per line, or neighbouring producers and consumers would keep
+    // stealing it from each other.
+    typedef struct {
+      alignas(cache_line) std::atomic<size_t> sequence;
+      T                                       data;
+    }
+    cell_t;
+
+    // a futex word bumped by every wake up, and how many sleep on it in the
+    // low half of state, how many of those were woken up already in the
+    // high half, so they don't get woken up again until they're back.
+    typedef struct {
+      alignas(cache_line) std::atomic<uint32_t> seq;
+      std::atomic<uint64_t>                     state;
+    }
+    waiters_t;
+
+    static const uint64_t sleeper = 1,
+                          woken   = 1ull << 32;
+
+    cell_t                             *_cells;
+    size_t                              _mask;
+    alignas(cache_line) std::atomic<size_t> _enqueue;
+    alignas(cache_line) std::atomic<size_t> _dequeue;
+    waiters_t                           _not_empty;
+    waiters_t                           _not_full;
+    std::atomic<bool>                   _closed;
+
+    static inline void relax() {
+#if defined(__x86_64__) || defined(__i386__)
+      __builtin_ia32_pause();
+#elif defined(__aarch64__)
+      asm volatile( "yield" );
+#endif
+    }
+
+    static inline void park( std::atomic<uint32_t>& word, uint32_t seen ) {
+      syscall( SYS_futex, (uint32_t *)&word, FUTEX_WAIT_PRIVATE, seen, NULL, NULL, 0 );
+    }
+
+    static inline void wake( waiters_t& w, uint32_t n ) {
+      w.seq.fetch_add( 1 );
+      syscall( SYS_futex, (uint32_t *)&w.seq, FUTEX_WAKE_PRIVATE, n > INT_MAX ? INT_MAX : (int)n, NULL, NULL, 0 );
+    }
+
+    // Wakes up to n sleepers, one per item made available.
+    static inline void signal( waiters_t& w, size_t n ) {
+      // pairs with the sleepers count in wait_for(): either we see the
+      // sleeper, or it sees what we just published before parking.
+      std::atomic_thread_fence( std::memory_order_seq_cst );
+
+      uint64_t state = w.state.load( std::memory_order_relaxed ),
+               wakes;
+      do {
+        uint32_t sleeping = (uint32_t)state,
+                 waking   = (uint32_t)( state >> 32 );
+        if( sleeping <= waking ) {
+          return;
+        }
+
+        wakes = n < sleeping - waking ? n : sleeping - waking;
+      }
+      while( !w.state.compare_exchange_weak( state, state + wakes * woken ) );
+
+      wake( w, wakes );
+    }
+
+    // Spins on op for a bit, then sleeps on w until it succeeds.
+    template <typename Op>
+    static inline void wait_for( waiters_t& w, Op op ) {
+      for( unsigned i = 0; i < spin_count; ++i ) {
+        if( op() ) {
+          return;
+        }
+        relax();
+      }
+
+      // the bump of seq by a wake up in between makes park() return.
+      while( true ) {
+        uint32_t seen = w.seq.load();
+        w.state.fetch_add( sleeper );
+
+        bool done = op();
+        if( !done ) {
+          park( w.seq, seen );
+        }
+
+        // whoever comes back takes one of the wake ups with it.
+        uint64_t state = w.state.load( std::memory_order_relaxed );
+        while( !w.state.compare_exchange_weak( state, state - sleeper - ( state >> 32 ? woken : 0 ) ) ) ;
+
+        if( done ) {
+          break;
+        }
+      }
+    }
 
   public:
 
-    void add(T item) {
-      std::unique_lock<std::mutex> lock(_mutex);
+    // capacity is rounded up to a power of two.
+    work_queue( size_t capacity = 4096 ) : _enqueue(0), _dequeue(0), _closed(false) {
+      size_t size = 2;
+      while( size < capacity ) {
+        size <<= 1;
+      }
+
+      _cells = new cell_t[size];
+      _mask  = size - 1;
 
-      _queue.push_back(item);
-      _avail.notify_one();
+      for( size_t i = 0; i < size; ++i ) {
+        _cells[i].sequence.store( i, std::memory_order_relaxed );
+      }
+
+      _not_empty.seq = _not_full.seq = 0;
+      _not_empty.state = _not_full.state = 0;
     }
 
-    T get() {
-      std::unique_lock<std::mutex> lock(_mutex);
+    ~work_queue() {
+      delete[] _cells;
+    }
+
+    work_queue( const work_queue& ) = delete;
+    work_queue& operator=( const work_queue& ) = delete;
+
+    // Returns false if the queue is full.
+    bool try_add( T item ) {
+      size_t pos = _enqueue.load( std::memory_order_relaxed );
+
+      while( true ) {
+        cell_t  *cell = &_cells[ pos & _mask ];
+        size_t   seq  = cell->sequence.load( std::memory_order_acquire );
+        intptr_t diff = (intptr_t)seq - (intptr_t)pos;
 
-      while( _queue.size() == 0 ) {
-        _avail.wait(lock);
+        if( diff == 0 ) {
+          if( _enqueue.compare_exchange_weak( pos, pos + 1, std::memory_order_relaxed ) ) {
+            cell->data = item;
+            cell->sequence.store( pos + 1, std::memory_order_release );
+            signal( _not_empty, 1 );
+            return true;
+          }
+        }
+        else if( diff < 0 ) {
+          return false;
+        }
+        else {
+          pos = _enqueue.load( std::memory_order_relaxed );
+        }
       }
+    }
+
+    // Returns false if the queue is empty.
+    bool try_get( T& item ) {
+      size_t pos = _dequeue.load( std::memory_order_relaxed );
+
+      while( true ) {
+        cell_t  *cell = &_cells[ pos & _mask ];
+        size_t   seq  = cell->sequence.load( std::memory_order_acquire );
+        intptr_t diff = (intptr_t)seq - (intptr_t)( pos + 1 );
+
+        if( diff == 0 ) {
+          if( _dequeue.compare_exchange_weak( pos, pos + 1, std::memory_order_relaxed ) ) {
+            item = cell->data;
+            cell->sequence.store( pos + _mask + 1, std::memory_order_release );
+            signal( _not_full, 1 );
+            return true;
+          }
+        }
+        else if( diff < 0 ) {
+          return false;
+        }
+        else {
+          pos = _dequeue.load( std::memory_order_relaxed );
+        }
+      }
+    }
+
+    // Adds as many of the n items as there's room for with a single index
+    // update and a single wake up syscall, returns how many.
+    size_t try_add_many( const T *items, size_t n ) {
+      size_t pos = _enqueue.load( std::memory_order_relaxed ),
+             free;
+
+      do {
+        // count the free cells right after pos.
+        for( free = 0; free < n; ++free ) {
+          cell_t *cell = &_cells[ ( pos + free ) & _mask ];
+          if( cell->sequence.load( std::memory_order_acquire ) != pos + free ) {
+            break;
+          }
+        }
+
+        if( free == 0 ) {
+          return 0;
+        }
+      }
+      while( !_enqueue.compare_exchange_weak( pos, pos + free, std::memory_order_relaxed ) );
+
+      for( size_t i = 0; i < free; ++i ) {
+        cell_t *cell = &_cells[ ( pos + i ) & _mask ];
+        cell->data = items[i];
+        cell->sequence.store( pos + i + 1, std::memory_order_release );
+      }
+
+      signal( _not_empty, free );
+      return free;
+    }
+
+    // Takes up to max items with a single index update, returns how many.
+    size_t try_get_many( T *items, size_t max ) {
+      size_t pos = _dequeue.load( std::memory_order_relaxed ),
+             ready;
+
+      do {
+        for( ready = 0; ready < max; ++ready ) {
+          cell_t *cell = &_cells[ ( pos + ready ) & _mask ];
+          if( cell->sequence.load( std::memory_order_acquire ) != pos + ready + 1 ) {
+            break;
+          }
+        }
+
+        if( ready == 0 ) {
+          return 0;
+        }
+      }
+      while( !_dequeue.compare_exchange_weak( pos, pos + ready, std::memory_order_relaxed ) );
 
-      T item = _queue.front();
-      _queue.pop_front();
+      for( size_t i = 0; i < ready; ++i ) {
+        cell_t *cell = &_cells[ ( pos + i ) & _mask ];
+        items[i] = cell->data;
+        cell->sequence.store( pos + i + _mask + 1, std::memory_order_release );
+      }
+
+      signal( _not_full, ready );
+      return ready;
+    }
 
+    // Blocks while the queue is full.
+    void add(T item) {
+      wait_for( _not_full, [&]() { return try_add(item); } );
+    }
+
+    // Blocks while the queue is empty, once it's closed and drained
+    // returns T() instead.
+    T get() {
+      T item = T();
+      wait_for( _not_empty, [&]() { return try_get(item) || _closed.load(); } );
       return item;
     }
 
+    // Blocks until all of the n items are in.
+    void add_many( const T *items, size_t n ) {
+      while( n ) {
+        size_t added = 0;
+        wait_for( _not_full, [&]() { return ( added = try_add_many( items, n ) ) > 0; } );
+        items += added;
+        n     -= added;
+      }
+    }
+
+    // Blocks until there's at least one item, then takes up to max, 
+    // returns 0 once the queue is closed and drained.
+    size_t get_many( T *items, size_t max ) {
+      size_t taken = 0;
+      wait_for( _not_empty, [&]() { return ( taken = try_get_many( items, max ) ) > 0 || _closed.load(); } );
+      return taken;
+    }
+
+    // Wakes up every consumer, they get what's left and then T().
+    void close() {
+      _closed.store( true );
+      wake( _not_empty, INT_MAX );
+    }
+
+    inline bool closed() const {
+      return _closed.load();
+    }
+
     int size() {
-      std::unique_lock<std::mutex> lock(_mutex);
+      size_t enq = _enqueue.load( std::memory_order_relaxed ),
+             deq = _dequeue.load( std::memory_order_relaxed );
+
+      return enq > deq ? (int)( enq - deq ) : 0;
+    }
 
-      return _queue.size();
+    inline size_t capacity() const {
+      return _mask + 1;
     }
 };
 
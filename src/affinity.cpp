@@ -0,0 +1,160 @@
+/*
+ * This file is part of librestd.
+ *
+ * Copyleft of Simone Margaritelli aka evilsocket <evilsocket@protonmail.com>
+ *
+ * librestd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * librestd is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with librestd.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "strings.h"
+#include "affinity.h"
+#include "log.h"
+
+#include <set>
+#include <fstream>
+#include <pthread.h>
+#include <sched.h>
+#include <dirent.h>
+
+namespace restd {
+namespace affinity {
+
+bool parse( const std::string& list, cpu_list_t& cpus ) {
+  std::set<int> unique;
+  size_t        start = 0;
+
+  while( start < list.size() ) {
+    size_t comma = list.find( ',', start );
+    if( comma == std::string::npos ) {
+      comma = list.size();
+    }
+
+    std::string range = list.substr( start, comma - start );
+    size_t      dash  = range.find('-');
+    int         from  = 0,
+                to    = 0;
+
+    try {
+      from = std::stoi( range.substr( 0, dash ) );
+      to   = dash == std::string::npos ? from : std::stoi( range.substr( dash + 1 ) );
+    }
+    catch( ... ) {
+      return false;
+    }
+
+    if( from < 0 || to < from || to >= CPU_SETSIZE ) {
+      return false;
+    }
+
+    for( int cpu = from; cpu <= to; ++cpu ) {
+      unique.insert(cpu);
+    }
+
+    start = comma + 1;
+  }
+
+  cpus.assign( unique.begin(), unique.end() );
+  return !cpus.empty();
+}
+
+std::string format( const cpu_list_t& cpus ) {
+  std::string out;
+
+  for( size_t i = 0; i < cpus.size(); ) {
+    size_t j = i;
+    while( j + 1 < cpus.size() && cpus[j + 1] == cpus[j] + 1 ) {
+      ++j;
+    }
+
+    if( !out.empty() ) {
+      out += ',';
+    }
+    out += std::to_string( cpus[i] );
+    if( j > i ) {
+      out += '-';
+      out += std::to_string( cpus[j] );
+    }
+
+    i = j + 1;
+  }
+
+  return out;
+}
+
+bool pin( const cpu_list_t& cpus ) {
+  cpu_set_t set;
+
+  CPU_ZERO(&set);
+  for( auto i = cpus.begin(), e = cpus.end(); i != e; ++i ) {
+    CPU_SET( *i, &set );
+  }
+
+  int err = pthread_setaffinity_np( pthread_self(), sizeof(set), &set );
+  if( err != 0 ) {
+    log( ERROR, "Could not pin thread to cpus %s: %s", format(cpus).c_str(), strerror(err) );
+    return false;
+  }
+  return true;
+}
+
+int node_of( int cpu ) {
+  // /sys/devices/system/cpu/cpuN/nodeM
+  std::string path = "/sys/devices/system/cpu/cpu" + std::to_string(cpu);
+  DIR        *dir  = opendir( path.c_str() );
+  int         node = 0;
+
+  if( dir ) {
+    struct dirent *entry;
+    while( ( entry = readdir(dir) ) != NULL ) {
+      if( strncmp( entry->d_name, "node", 4 ) == 0 && isdigit( entry->d_name[4] ) ) {
+        node = atoi( entry->d_name + 4 );
+        break;
+      }
+    }
+    closedir(dir);
+  }
+
+  return node;
+}
+
+cpu_list_t nic_cpus( const std::string& interface ) {
+  std::string   path = "/sys/class/net/" + interface + "/device/msi_irqs";
+  DIR          *dir  = opendir( path.c_str() );
+  std::set<int> unique;
+
+  if( !dir ) {
+    log( WARNING, "Could not list the interrupts of %s.", interface.c_str() );
+    return cpu_list_t();
+  }
+
+  struct dirent *entry;
+  while( ( entry = readdir(dir) ) != NULL ) {
+    if( !isdigit( entry->d_name[0] ) ) {
+      continue;
+    }
+
+    std::ifstream list( std::string("/proc/irq/") + entry->d_name + "/smp_affinity_list" );
+    std::string   line;
+    cpu_list_t    cpus;
+
+    if( std::getline( list, line ) && parse( line, cpus ) ) {
+      unique.insert( cpus.begin(), cpus.end() );
+    }
+  }
+  closedir(dir);
+
+  return cpu_list_t( unique.begin(), unique.end() );
+}
+
+}
+}
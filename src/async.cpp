@@ -0,0 +1,270 @@
+/*
+ * This file is part of librestd.
+ *
+ * Copyleft of Simone Margaritelli aka evilsocket <evilsocket@protonmail.com>
+ *
+ * librestd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * librestd is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with librestd.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "strings.h"
+#include "async.h"
+#include "log.h"
+
+#if defined(__cpp_impl_coroutine)
+
+#include <cerrno>
+#include <mutex>
+#include <map>
+#include <vector>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+namespace restd {
+
+// Timers and descriptors coroutines are waiting for, one thread doing
+// nothing but epoll_wait, ready coroutines are resumed on their pool.
+class io_loop
+{
+  private:
+
+    static const int max_events = 64;
+
+    typedef struct {
+      std::coroutine_handle<> handle;
+      scheduler              *pool;
+    }
+    sleeper_t;
+
+    typedef std::multimap<std::chrono::steady_clock::time_point, sleeper_t> timers_t;
+
+    int         _epoll;
+    int         _wakeup;
+    bool        _running;
+    std::mutex  _mutex;
+    timers_t    _timers;
+    std::thread _thread;
+
+    io_loop();
+    ~io_loop();
+
+    void run();
+    void wake();
+    // Milliseconds until the next timer, -1 if there's none.
+    int next_timeout();
+    void expire();
+
+  public:
+
+    static io_loop& instance();
+
+    void at( std::chrono::steady_clock::time_point when, std::coroutine_handle<> handle, scheduler *pool );
+    // False with errno set if the descriptor can't be watched.
+    bool watch( fd_awaiter *waiter );
+};
+
+io_loop::io_loop() : _running(true) {
+  _epoll  = epoll_create1( EPOLL_CLOEXEC );
+  _wakeup = eventfd( 0, EFD_CLOEXEC | EFD_NONBLOCK );
+
+  struct epoll_event ev = {};
+  ev.events   = EPOLLIN;
+  ev.data.ptr = NULL;
+  epoll_ctl( _epoll, EPOLL_CTL_ADD, _wakeup, &ev );
+
+  _thread = std::thread( &io_loop::run, this );
+}
+
+io_loop::~io_loop() {
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _running = false;
+  }
+
+  wake();
+  _thread.join();
+
+  close( _wakeup );
+  close( _epoll );
+}
+
+io_loop& io_loop::instance() {
+  static io_loop loop;
+  return loop;
+}
+
+void io_loop::wake() {
+  uint64_t one = 1;
+  if( ::write( _wakeup, &one, sizeof(one) ) != sizeof(one) ) {
+    log( ERROR, "Could not wake up the io loop: %s", strerror(errno) );
+  }
+}
+
+void io_loop::at( std::chrono::steady_clock::time_point when, std::coroutine_handle<> handle, scheduler *pool ) {
+  bool earliest;
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    earliest = _timers.empty() || when < _timers.begin()->first;
+    _timers.emplace( when, sleeper_t{ handle, pool } );
+  }
+
+  // the loop is sleeping for longer than that.
+  if( earliest ) {
+    wake();
+  }
+}
+
+bool io_loop::watch( fd_awaiter *waiter ) {
+  struct epoll_event ev = {};
+  ev.events   = waiter->_events | EPOLLONESHOT;
+  ev.data.ptr = waiter;
+  return epoll_ctl( _epoll, EPOLL_CTL_ADD, waiter->_fd, &ev ) == 0;
+}
+
+int io_loop::next_timeout() {
+  std::lock_guard<std::mutex> lock(_mutex);
+  if( _timers.empty() ) {
+    return -1;
+  }
+
+  auto left = _timers.begin()->first - std::chrono::steady_clock::now();
+  if( left <= std::chrono::steady_clock::duration::zero() ) {
+    return 0;
+  }
+  // rounded up, better late than spinning.
+  return (int)std::chrono::ceil<std::chrono::milliseconds>( left ).count();
+}
+
+void io_loop::expire() {
+  std::vector<sleeper_t> due;
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto end = _timers.upper_bound( std::chrono::steady_clock::now() );
+
+    for( auto i = _timers.begin(); i != end; ++i ) {
+      due.push_back( i->second );
+    }
+    _timers.erase( _timers.begin(), end );
+  }
+
+  for( auto i = due.begin(), e = due.end(); i != e; ++i ) {
+    resume_on( i->pool, i->handle );
+  }
+}
+
+void io_loop::run() {
+  struct epoll_event events[max_events];
+
+  while( true ) {
+    int n = epoll_wait( _epoll, events, max_events, next_timeout() );
+
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      if( !_running ) {
+        break;
+      }
+    }
+
+    for( int i = 0; i < n; ++i ) {
+      fd_awaiter *waiter = (fd_awaiter *)events[i].data.ptr;
+      if( waiter == NULL ) {
+        uint64_t value;
+        if( ::read( _wakeup, &value, sizeof(value) ) < 0 && errno != EAGAIN ) {
+          log( ERROR, "Could not read from the io loop eventfd: %s", strerror(errno) );
+        }
+        continue;
+      }
+
+      scheduler              *pool   = waiter->_pool;
+      std::coroutine_handle<> handle = waiter->_handle;
+
+      // removed before resuming, the coroutine may wait on it again.
+      epoll_ctl( _epoll, EPOLL_CTL_DEL, waiter->_fd, NULL );
+      resume_on( pool, handle );
+    }
+
+    expire();
+  }
+}
+
+void resume_on( scheduler *pool, std::coroutine_handle<> handle ) {
+  if( pool ) {
+    pool->submit( [handle]() {
+      handle.resume();
+    });
+  } else {
+    handle.resume();
+  }
+}
+
+void timer_awaiter::await_suspend( std::coroutine_handle<> handle ) {
+  io_loop::instance().at( _when, handle, scheduler::current() );
+}
+
+bool fd_awaiter::await_suspend( std::coroutine_handle<> handle ) {
+  _handle = handle;
+  _pool   = scheduler::current();
+
+  // once watched we might be resumed at any time, don't touch this.
+  if( io_loop::instance().watch( this ) == false ) {
+    _error = errno;
+    return false;
+  }
+  return true;
+}
+
+fd_awaiter readable( int fd ) {
+  return fd_awaiter( fd, EPOLLIN | EPOLLRDHUP );
+}
+
+fd_awaiter writable( int fd ) {
+  return fd_awaiter( fd, EPOLLOUT );
+}
+
+async<ssize_t> async_read( int fd, void *buffer, size_t size ) {
+  while( true ) {
+    ssize_t r = ::read( fd, buffer, size );
+    if( r >= 0 ) {
+      co_return r;
+    }
+    else if( errno == EINTR ) {
+      continue;
+    }
+    else if( ( errno != EAGAIN && errno != EWOULDBLOCK ) || co_await readable(fd) == false ) {
+      co_return -1;
+    }
+  }
+}
+
+async<ssize_t> async_write( int fd, const void *buffer, size_t size ) {
+  size_t written = 0;
+
+  while( written < size ) {
+    ssize_t w = ::write( fd, (const char *)buffer + written, size - written );
+    if( w >= 0 ) {
+      written += w;
+    }
+    else if( errno == EINTR ) {
+      continue;
+    }
+    else if( ( errno != EAGAIN && errno != EWOULDBLOCK ) || co_await writable(fd) == false ) {
+      co_return -1;
+    }
+  }
+
+  co_return (ssize_t)written;
+}
+
+}
+
+#endif
@@ -0,0 +1,96 @@
+/*
+ * This file is part of librestd.
+ *
+ * Copyleft of Simone Margaritelli aka evilsocket <evilsocket@protonmail.com>
+ *
+ * librestd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * librestd is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with librestd.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "blocking.h"
+#include "log.h"
+
+#include <thread>
+
+namespace restd {
+
+blocking_pool::blocking_pool( unsigned int max_threads /* = 64 */ ) :
+  _threads(0),
+  _idle(0),
+  _running(true),
+  max_threads(max_threads),
+  keep_alive(10) {
+
+}
+
+blocking_pool::~blocking_pool() {
+  std::unique_lock<std::mutex> lock(_mutex);
+
+  _running = false;
+  _wakeup.notify_all();
+  _done.wait( lock, [this]() { return _threads == 0; } );
+}
+
+blocking_pool& blocking_pool::shared() {
+  static blocking_pool pool;
+  return pool;
+}
+
+void blocking_pool::submit( task_t task ) {
+  std::lock_guard<std::mutex> lock(_mutex);
+
+  _tasks.push_back( std::move(task) );
+
+  // idle threads might be already woken up for the tasks before this one.
+  if( _tasks.size() > _idle && _threads < max_threads ) {
+    _threads++;
+    log( DEBUG, "Starting blocking thread #%u.", _threads );
+    std::thread( &blocking_pool::run, this ).detach();
+  } else {
+    _wakeup.notify_one();
+  }
+}
+
+void blocking_pool::run() {
+  std::unique_lock<std::mutex> lock(_mutex);
+  task_t task;
+
+  while( true ) {
+    if( !_tasks.empty() ) {
+      task = std::move( _tasks.front() );
+      _tasks.pop_front();
+
+      lock.unlock();
+      task();
+      task = nullptr;
+      lock.lock();
+      continue;
+    }
+    else if( !_running ) {
+      break;
+    }
+
+    _idle++;
+    bool woken = _wakeup.wait_for( lock, keep_alive, [this]() { return !_tasks.empty() || !_running; } );
+    _idle--;
+
+    // nothing to do for a while, the pool shrinks.
+    if( !woken ) {
+      break;
+    }
+  }
+
+  _threads--;
+  _done.notify_all();
+}
+
+}
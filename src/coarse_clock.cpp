@@ -0,0 +1,124 @@
+/*
+ * This file is part of librestd.
+ *
+ * Copyleft of Simone Margaritelli aka evilsocket <evilsocket@protonmail.com>
+ *
+ * librestd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * librestd is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with librestd.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "strings.h"
+#include "coarse_clock.h"
+
+#include <chrono>
+
+namespace restd {
+
+static const char *kDays[]   = { "Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat" };
+static const char *kMonths[] = { "Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec" };
+
+coarse_clock::coarse_clock() : _current(0), _log_format("%m/%d/%Y %X"), _running(true) {
+  tick();
+  _thread = std::thread( &coarse_clock::run, this );
+}
+
+coarse_clock::~coarse_clock() {
+  {
+    std::unique_lock<std::mutex> lock(_mutex);
+    _running = false;
+  }
+
+  _wakeup.notify_one();
+  _thread.join();
+}
+
+coarse_clock& coarse_clock::instance() {
+  static coarse_clock clock;
+  return clock;
+}
+
+void coarse_clock::tick() {
+  unsigned next = ( _current.load( std::memory_order_relaxed ) + 1 ) % n_slots;
+  slot_t&  slot = _slots[next];
+  struct tm gmt, local;
+
+  slot.seq.fetch_add( 1, std::memory_order_relaxed );
+  std::atomic_thread_fence( std::memory_order_release );
+
+  // not time(NULL), the coarse realtime clock it reads can still be on the
+  // previous second right after the boundary we woke up on.
+  slot.now = std::chrono::system_clock::to_time_t( std::chrono::system_clock::now() );
+
+  // the fields are clamped to the widths the format gives them, so the
+  // value always fits and never gets truncated.
+  gmtime_r( &slot.now, &gmt );
+  snprintf( slot.date, sizeof(slot.date), "%s, %02u %s %04u %02u:%02u:%02u GMT",
+            kDays[gmt.tm_wday], (unsigned)gmt.tm_mday % 100, kMonths[gmt.tm_mon],
+            (unsigned)( gmt.tm_year + 1900 ) % 10000, (unsigned)gmt.tm_hour % 100,
+            (unsigned)gmt.tm_min % 100, (unsigned)gmt.tm_sec % 100 );
+
+  localtime_r( &slot.now, &local );
+  slot.stamp_len = strftime( slot.stamp, sizeof(slot.stamp), _log_format.c_str(), &local );
+
+  slot.seq.fetch_add( 1, std::memory_order_release );
+  _current.store( next, std::memory_order_release );
+}
+
+void coarse_clock::run() {
+  std::unique_lock<std::mutex> lock(_mutex);
+
+  while( _running ) {
+    // wake up right after the next second boundary.
+    auto now  = std::chrono::system_clock::now();
+    auto next = std::chrono::time_point_cast<std::chrono::seconds>(now) + std::chrono::seconds(1);
+
+    _wakeup.wait_until( lock, next );
+    if( _running ) {
+      tick();
+    }
+  }
+}
+
+time_t coarse_clock::now() {
+  time_t now = 0;
+  read( [&now]( const slot_t& slot ) {
+    now = slot.now;
+  });
+  return now;
+}
+
+coarse_clock::date_t coarse_clock::date() {
+  date_t date;
+  read( [&date]( const slot_t& slot ) {
+    memcpy( date.value, slot.date, date_size );
+  });
+  return date;
+}
+
+size_t coarse_clock::log_timestamp( char *out ) {
+  size_t len = 0;
+  read( [out, &len]( const slot_t& slot ) {
+    len = slot.stamp_len;
+    memcpy( out, slot.stamp, len );
+  });
+  return len;
+}
+
+void coarse_clock::set_log_format( const char *format ) {
+  coarse_clock& clock = instance();
+  std::unique_lock<std::mutex> lock(clock._mutex);
+
+  clock._log_format = format;
+  clock.tick();
+}
+
+}
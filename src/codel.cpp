@@ -0,0 +1,61 @@
+/*
+ * This file is part of librestd.
+ *
+ * Copyleft of Simone Margaritelli aka evilsocket <evilsocket@protonmail.com>
+ *
+ * librestd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * librestd is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with librestd.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "codel.h"
+
+namespace restd {
+
+codel::codel( std::chrono::milliseconds target /* = 20ms */, std::chrono::milliseconds interval /* = 100ms */ ) :
+  _target(target),
+  _interval(interval),
+  _first_above(0),
+  _shed(0) {
+
+}
+
+void codel::configure( std::chrono::milliseconds target, std::chrono::milliseconds interval ) {
+  _target   = target;
+  _interval = interval;
+}
+
+bool codel::admit( std::chrono::steady_clock::time_point enqueued ) {
+  auto    now     = std::chrono::steady_clock::now();
+  auto    sojourn = now - enqueued;
+  int64_t ticks   = now.time_since_epoch().count();
+
+  if( sojourn < _target ) {
+    _first_above.store( 0, std::memory_order_relaxed );
+    return true;
+  }
+
+  int64_t first_above = _first_above.load( std::memory_order_relaxed );
+  if( first_above == 0 ) {
+    // concurrent requests above target agree on the first deadline.
+    int64_t deadline = ticks + std::chrono::duration_cast<std::chrono::steady_clock::duration>( _interval ).count();
+    _first_above.compare_exchange_strong( first_above, deadline, std::memory_order_relaxed );
+    return true;
+  }
+  else if( ticks < first_above ) {
+    return true;
+  }
+
+  _shed.fetch_add( 1, std::memory_order_relaxed );
+  return false;
+}
+
+}
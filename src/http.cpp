@@ -18,9 +18,11 @@
 */
 #include "http.h"
 #include "log.h"
+#include "coarse_clock.h"
 
 #include <regex>
-#include <sstream>
+#include <charconv>
+#include <string_view>
 
 namespace restd {
 
@@ -36,7 +38,7 @@ static const std::regex kHeaderParser("([^\\s]+)\\s*:\\s*(.+)\r\n");
 const unsigned int http_request::chunk_size;
 const unsigned int http_request::read_timeout;
 
-http_request::http_request() : parser_state(PARSE_BEGIN), content_length(0) {
+http_request::http_request() : parser_state(PARSE_BEGIN), n_path_params(0), content_length(0) {
 
 }
 
@@ -248,7 +250,7 @@ bool http_request::parse_body() {
   return true;
 }
 
-string http_response::statusMessage( http_response::Status s ) {
+const char *http_response::statusMessage( http_response::Status s ) {
   switch(s) { 
     case HTTP_STATUS_OK: return "Ok";
     case HTTP_STATUS_CREATED: return "Created";
@@ -264,6 +266,7 @@ string http_response::statusMessage( http_response::Status s ) {
     case HTTP_STATUS_UNAUTHORIZED: return "Unauthorized";
     case HTTP_STATUS_FORBIDDEN: return "Forbidden";
     case HTTP_STATUS_NOT_FOUND: return "Not Found";
+    case HTTP_STATUS_NOT_ACCEPTABLE: return "Not Acceptable";
     case HTTP_STATUS_INTERNAL: return "Internal Error";
     case HTTP_STATUS_NOT_IMPLEMENTED: return "Not Implemented";
     case HTTP_STATUS_BAD_GATEWAY: return "Bad Gateway";
@@ -273,78 +276,299 @@ string http_response::statusMessage( http_response::Status s ) {
   return "Unknown";
 }
 
-http_response::http_response() : status(HTTP_STATUS_OK) {
+http_response::http_response() : status(HTTP_STATUS_OK), channel(NULL), _json_mode(JSON_NONE) {
 
 }
 
 http_response::http_response( Status status_, string body_ /* = "" */, string content_type /* = "text/plain" */  ) :
-  status(status_), body(body_) {
+  status(status_), body(body_), channel(NULL), _json_mode(JSON_NONE) {
   if( !content_type.empty() ){
     headers["Content-Type"] = content_type;
   }
 }
 
+void http_response::set_body( string body, http_response::Status status, const char *content_type ) {
+  this->status = status;
+  this->body   = std::move(body);
+  this->headers["Content-Type"] = content_type;
+
+  _json_mode  = JSON_NONE;
+  json_body   = nullptr;
+  json_stream = nullptr;
+  generator   = nullptr;
+  channel     = NULL;
+}
+
 void http_response::bad_request() {
-  status = http_response::HTTP_STATUS_BAD_REQUEST;
-  body   = "Bad Request";
-  headers["Content-Type"] = "text/plain; charset=utf-8";
+  set_body( "Bad Request", http_response::HTTP_STATUS_BAD_REQUEST, "text/plain; charset=utf-8" );
 }
 
 void http_response::not_found() {
-  status = http_response::HTTP_STATUS_NOT_FOUND;
-  body   = "Not Found ¯\\_(ツ)_/¯";
-  headers["Content-Type"] = "text/plain; charset=utf-8";
+  set_body( "Not Found ¯\\_(ツ)_/¯", http_response::HTTP_STATUS_NOT_FOUND, "text/plain; charset=utf-8" );
+}
+
+void http_response::not_acceptable() {
+  set_body( "Not Acceptable", http_response::HTTP_STATUS_NOT_ACCEPTABLE, "text/plain; charset=utf-8" );
+}
+
+void http_response::unavailable( unsigned int retry_after ) {
+  set_body( "Service Unavailable", http_response::HTTP_STATUS_UNAVAILABLE, "text/plain; charset=utf-8" );
+  headers["Retry-After"] = std::to_string( retry_after );
+}
+
+void http_response::subscribe( http_sse_channel& channel ) {
+  set_body( "", http_response::HTTP_STATUS_OK, "text/event-stream" );
+  headers["Cache-Control"] = "no-cache";
+
+  this->channel = &channel;
+}
+
+void http_response::not_modified() {
+  set_body( "", http_response::HTTP_STATUS_NOT_MODIFIED, "" );
+  headers.erase("Content-Type");
+}
+
+void http_response::etag( const string& version, bool weak /* = false */ ) {
+  headers["ETag"] = ( weak ? "W/\"" : "\"" ) + version + "\"";
 }
 
 void http_response::text( string text, http_response::Status status /* = http_response::HTTP_STATUS_OK */ ) {
-  status = status;
-  body   = text;
-  headers["Content-Type"] = "text/plain";
+  set_body( std::move(text), status, "text/plain" );
 }
 
 void http_response::html( string html, http_response::Status status /* = http_response::HTTP_STATUS_OK */ ) {
-  status = status;
-  body   = html;
-  headers["Content-Type"] = "text/html; charset=utf-8";
+  set_body( std::move(html), status, "text/html; charset=utf-8" );
 }
 
 void http_response::json( string json, http_response::Status status /* = http_response::HTTP_STATUS_OK */ ) {
-  status = status;
-  body   = json;
-  headers["Content-Type"] = "application/json";
+  set_body( std::move(json), status, "application/json" );
 }
 
-std::string http_response::str() {
-  std::stringstream ss;
+void http_response::json( const char *json, http_response::Status status /* = http_response::HTTP_STATUS_OK */ ) {
+  set_body( json, status, "application/json" );
+}
+
+void http_response::json( nlohmann::json json, http_response::Status status /* = http_response::HTTP_STATUS_OK */ ) {
+  set_body( string(), status, "application/json" );
+
+  _json_mode = JSON_VALUE;
+  json_body  = std::move(json);
+}
+
+void http_response::stream_json( json_stream_t stream, http_response::Status status /* = http_response::HTTP_STATUS_OK */ ) {
+  set_body( string(), status, "application/json" );
+
+  _json_mode  = JSON_STREAM;
+  json_stream = std::move(stream);
+}
+
+static const std::string_view kServerHeader     = "Server: " HTTP_SERVER_SOFTWARE "\r\n";
+static const std::string_view kConnectionHeader = "Connection: close\r\n";
+static const std::string_view kDateHeader       = "Date: ";
+static const std::string_view kChunkedHeader    = "Transfer-Encoding: chunked\r\n";
+static const std::string_view kContentLength    = "Content-Length: ";
+static const std::string_view kCRLF             = "\r\n";
+// digits of the largest size_t.
+static const size_t           kContentLengthWidth = 20;
+
+static const unsigned int kMaxStatus = 600;
+
+// "HTTP/1.1 200 Ok\r\n" and friends, indexed by status code.
+class status_lines
+{
+  private:
+
+    std::string      _storage[kMaxStatus];
+    std::string_view _lines[kMaxStatus];
+
+  public:
+
+    status_lines( const char *(*message)( http_response::Status ) ) {
+      for( unsigned int code = 100; code < kMaxStatus; ++code ) {
+        const char *msg = message( (http_response::Status)code );
+        if( strcmp( msg, "Unknown" ) != 0 ) {
+          _storage[code] = "HTTP/1.1 " + std::to_string(code) + " " + msg + "\r\n";
+          _lines[code]   = _storage[code];
+        }
+      }
+    }
+
+    inline std::string_view get( unsigned int code ) const {
+      return code < kMaxStatus ? _lines[code] : std::string_view();
+    }
+};
+
+static inline void append_number( std::string& out, size_t n ) {
+  char buf[32];
+  auto r = std::to_chars( buf, buf + sizeof(buf), n );
+  out.append( buf, r.ptr - buf );
+}
+
+void http_response::stream( stream_generator_t generator, const char *content_type /* = "application/octet-stream" */, http_response::Status status /* = http_response::HTTP_STATUS_OK */ ) {
+  set_body( string(), status, content_type );
+
+  this->generator = std::move(generator);
+}
+
+bool http_response::serialize_head( std::string& out, bool own_length ) const {
+  static const status_lines kStatusLines( statusMessage );
+
+  std::string_view line = kStatusLines.get( status );
+  if( line.empty() ) {
+    out += "HTTP/1.1 ";
+    append_number( out, (size_t)status );
+    out += " ";
+    out += statusMessage(status);
+    out += kCRLF;
+  } else {
+    out += line;
+  }
+
+  bool has_server = false,
+       has_date   = false,
+       has_length = false,
+       has_conn   = false;
 
-  ss << "HTTP/1.1 " << (int)status << " " << statusMessage(status) << "\r\n";
-  
   for( auto i = headers.begin(), e = headers.end(); i != e; ++i ){
-    ss << i->first << ": " << i->second << "\r\n";
+    const string& name = i->first;
+
+    has_server = has_server || name == "Server";
+    has_date   = has_date   || name == "Date";
+    has_conn   = has_conn   || name == "Connection";
+
+    if( name == "Content-Length" ) {
+      has_length = true;
+      if( own_length ) {
+        continue;
+      }
+    }
+
+    out += name;
+    out += ": ";
+    out += i->second;
+    out += kCRLF;
+  }
+
+  if( !has_server ){
+    out += kServerHeader;
+  }
+
+  if( !has_date ){
+    out += kDateHeader;
+    out.append( coarse_clock::date().value, coarse_clock::date_size );
+    out += kCRLF;
+  }
+
+  if( !has_conn ){
+    out += kConnectionHeader;
   }
 
-  if( headers.find("Server") == headers.end() ){
-    ss << "Server: " << HTTP_SERVER_SOFTWARE << "\r\n";
+  return has_length;
+}
+
+size_t http_response::serialize( std::string& out ) const {
+  bool has_length = serialize_head( out, _json_mode != JSON_NONE );
+
+  if( generator ) {
+    out += kChunkedHeader;
+    out += kCRLF;
+    return 0;
   }
 
-  if( headers.find("Content-Length") == headers.end() && !body.empty() ){
-    ss << "Content-Length: " << body.size() << "\r\n";
+  // the body is whatever the channel will publish until the connection is closed.
+  if( channel ) {
+    out += kCRLF;
+    return 0;
   }
 
-  if( headers.find("Connection") == headers.end() ){
-    ss << "Connection: close\r\n";
+  // these can't have a body, not even an empty one.
+  if( status == HTTP_STATUS_NO_CONTENT || status == HTTP_STATUS_NOT_MODIFIED ) {
+    out += kCRLF;
+    return 0;
   }
 
-  ss << "\r\n";
+  if( _json_mode != JSON_NONE ) {
+    // the size is only known once the body has been written, so its value
+    // gets a slot wide enough for any size, filled in place afterwards:
+    // the spaces left after it are valid trailing header whitespace and
+    // the body is never moved.
+    out += kContentLength;
+    size_t length_at = out.size();
+    out.append( kContentLengthWidth, ' ' );
+    out += kCRLF;
+    out += kCRLF;
+
+    size_t size = write_body( out );
+    std::to_chars( &out[length_at], &out[length_at] + kContentLengthWidth, size );
+    return size;
+  }
+
+  if( !has_length && !body.empty() ){
+    out += kContentLength;
+    append_number( out, body.size() );
+    out += kCRLF;
+  }
+
+  out += kCRLF;
 
   if( body.empty() ){
-    ss << "\r\n";
+    out += kCRLF;
   }
   else {
-    ss << body;
+    out += body;
   }
 
-  return ss.str();
+  return body.size();
+}
+
+size_t http_response::serialize( std::string& out, std::string_view body ) const {
+  serialize_head( out, true );
+
+  out += kContentLength;
+  append_number( out, body.size() );
+  out += kCRLF;
+  out += kCRLF;
+  out += body;
+
+  return body.size();
+}
+
+size_t http_response::write_body( std::string& out ) const {
+  if( _json_mode == JSON_NONE ) {
+    out += body;
+    return body.size();
+  }
+
+  size_t at = out.size();
+  restd::json_writer writer( out );
+
+  if( _json_mode == JSON_VALUE ) {
+    writer.value( json_body );
+  } else {
+    json_stream( writer );
+  }
+
+  return out.size() - at;
+}
+
+void http_response::flatten() {
+  if( _json_mode == JSON_NONE ) {
+    return;
+  }
+
+  string flat;
+  write_body( flat );
+
+  body        = std::move(flat);
+  _json_mode  = JSON_NONE;
+  json_body   = nullptr;
+  json_stream = nullptr;
+}
+
+std::string http_response::str() const {
+  std::string out;
+  serialize( out );
+  return out;
 }
 
 }
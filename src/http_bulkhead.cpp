@@ -0,0 +1,144 @@
+/*
+ * This file is part of librestd.
+ *
+ * Copyleft of Simone Margaritelli aka evilsocket <evilsocket@protonmail.com>
+ *
+ * librestd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * librestd is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with librestd.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "http_bulkhead.h"
+#include "log.h"
+
+#include <stdexcept>
+
+namespace restd {
+
+void http_bulkhead_consumer::consume( http_job *job ) {
+  _bulkhead->execute( job );
+  _bulkhead->_queued--;
+}
+
+http_bulkhead::http_bulkhead( string name, unsigned int max_concurrent, unsigned int max_queued /* = 0 */, unsigned int threads /* = 0 */, scheduler *pool /* = NULL */ ) :
+  _name(name),
+  _max_concurrent(max_concurrent),
+  _max_queued(max_queued),
+  _threads(threads),
+  _running(0),
+  _queued(0),
+  _pool(pool) {
+
+  if( threads && threads != max_concurrent ) {
+    throw std::invalid_argument( "Bulkhead '" + name + "' runs as many requests at once as it has threads." );
+  }
+
+  for( unsigned int i = 0; i < _threads; ++i ){
+    _consumers.push_back( new http_bulkhead_consumer(_queue, this) );
+  }
+}
+
+http_bulkhead::~http_bulkhead() {
+  stop();
+
+  for( auto i = _consumers.begin(), e = _consumers.end(); i != e; ++i ){
+    delete (*i);
+  }
+
+  _consumers.clear();
+}
+
+void http_bulkhead::start() {
+  for( auto i = _consumers.begin(), e = _consumers.end(); i != e; ++i ){
+    (*i)->start();
+  }
+}
+
+void http_bulkhead::stop() {
+  for( auto i = _consumers.begin(), e = _consumers.end(); i != e; ++i ){
+    (*i)->stop();
+  }
+}
+
+void http_bulkhead::execute( http_job *job ) {
+  job->process();
+  job->respond();
+  delete job;
+}
+
+void http_bulkhead::reject( http_job *job ) {
+  log( WARNING, "Bulkhead '%s' is full, rejecting '%s %s'.", _name.c_str(), job->request.method_name().c_str(), job->request.path.c_str() );
+
+  job->response.unavailable( retry_after );
+  job->respond();
+  delete job;
+}
+
+void http_bulkhead::run( http_job *job ) {
+  while( job ) {
+    execute( job );
+
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+
+      if( _pending.empty() ) {
+        _running--;
+        return;
+      }
+
+      job = _pending.front();
+      _pending.pop_front();
+    }
+
+    // hand the slot and the next request to the workers instead of
+    // running the whole queue on this one.
+    if( _pool ) {
+      _pool->submit( [this, job]() {
+        run( job );
+      });
+      return;
+    }
+  }
+}
+
+void http_bulkhead::submit( http_job *job ) {
+  // dedicated pool, just check the queue bound.
+  if( _threads ) {
+    if( ++_queued > _max_concurrent + _max_queued ) {
+      _queued--;
+      reject( job );
+    } else {
+      _queue.add( job );
+    }
+    return;
+  }
+
+  {
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    if( _running >= _max_concurrent ) {
+      if( _pending.size() < _max_queued ) {
+        _pending.push_back( job );
+        return;
+      }
+
+      lock.unlock();
+      reject( job );
+      return;
+    }
+
+    _running++;
+  }
+
+  run( job );
+}
+
+}
@@ -0,0 +1,203 @@
+/*
+ * This file is part of librestd.
+ *
+ * Copyleft of Simone Margaritelli aka evilsocket <evilsocket@protonmail.com>
+ *
+ * librestd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * librestd is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with librestd.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "strings.h"
+#include "http_cache.h"
+#include "http_route.h"
+#include "coarse_clock.h"
+#include "log.h"
+
+namespace restd {
+
+// rough per entry bookkeeping cost, counted against max_bytes.
+static const size_t kEntryOverhead = 128;
+
+http_cache::http_cache() : _used(false), max_bytes( 64 * 1024 * 1024 ) {
+  for( unsigned int i = 0; i < n_shards; ++i ) {
+    _shards[i].size = 0;
+  }
+}
+
+uint64_t http_cache::route_hash( const http_request& req ) {
+  uint64_t h = strings::hash( (const char *)&req.method, sizeof(req.method) );
+  h = strings::hash( req.host, h );
+  return strings::hash( req.path, h );
+}
+
+uint64_t http_cache::key( const http_route *route, const http_request& req, ContentEncoding encoding, string& out ) {
+  out.clear();
+  out += req.method_name();
+  out += '\n';
+  out += req.host;
+  out += '\n';
+  out += req.path;
+
+  for( auto i = route->cache_key.params.begin(), e = route->cache_key.params.end(); i != e; ++i ) {
+    auto p = req.parameters.find( *i );
+    out += '\n';
+    if( p != req.parameters.end() ) {
+      out += p->second;
+    }
+  }
+
+  for( auto i = route->cache_key.headers.begin(), e = route->cache_key.headers.end(); i != e; ++i ) {
+    auto h = req.headers.find( *i );
+    out += '\n';
+    if( h != req.headers.end() ) {
+      out += h->second;
+    }
+  }
+
+  out += '\n';
+  out += (char)( '0' + encoding );
+
+  return strings::hash( out );
+}
+
+http_cached_t http_cache::freeze( string bytes ) {
+  http_cached_t frozen;
+
+  // the Date value is rewritten on every send, as long as it's one of ours.
+  size_t head_end = bytes.find( "\r\n\r\n" ),
+         date_at  = bytes.find( "\r\nDate: " ),
+         value_at = date_at + 8,
+         date_end = date_at < head_end ? bytes.find( "\r\n", value_at ) : string::npos;
+
+  frozen.date_at = date_end != string::npos && date_end - value_at == coarse_clock::date_size ? value_at : string::npos;
+  frozen.bytes   = std::make_shared<const string>( std::move(bytes) );
+  return frozen;
+}
+
+ssize_t http_cache::send( tcp_stream *client, const http_cached_t& frozen ) {
+  const string&        bytes = *frozen.bytes;
+  // copied, the clock's own buffer could be reused during a slow write.
+  coarse_clock::date_t date  = coarse_clock::date();
+  struct iovec         iov[3];
+  int                  n = 0;
+
+  if( frozen.date_at == string::npos || frozen.date_at + coarse_clock::date_size > bytes.size() ) {
+    iov[n++] = { (void *)bytes.data(), bytes.size() };
+  }
+  else {
+    iov[n++] = { (void *)bytes.data(), frozen.date_at };
+    iov[n++] = { (void *)date.value, coarse_clock::date_size };
+    iov[n++] = { (void *)( bytes.data() + frozen.date_at + coarse_clock::date_size ), bytes.size() - frozen.date_at - coarse_clock::date_size };
+  }
+
+  return client->send( iov, n );
+}
+
+http_route *http_cache::route_for( const http_request& req ) {
+  if( _used.load( std::memory_order_relaxed ) == false ) {
+    return NULL;
+  }
+
+  uint64_t h = route_hash( req );
+  shard_t& s = shard( h );
+  std::lock_guard<std::mutex> lock( s.mutex );
+
+  auto i = s.routes.find( h );
+  return i == s.routes.end() ? NULL : i->second;
+}
+
+void http_cache::evict( shard_t& shard, std::unordered_map<uint64_t, entry_t>::iterator i ) {
+  shard.size -= i->second.key.size() + i->second.bytes->size() + kEntryOverhead;
+  shard.lru.erase( i->second.lru );
+  shard.entries.erase( i );
+}
+
+bool http_cache::lookup( uint64_t hash, const string& key, http_cached_t& hit ) {
+  shard_t& s = shard( hash );
+  std::lock_guard<std::mutex> lock( s.mutex );
+
+  auto i = s.entries.find( hash );
+  if( i == s.entries.end() || i->second.key != key ) {
+    return false;
+  }
+  else if( i->second.expires <= coarse_clock::now() ) {
+    evict( s, i );
+    return false;
+  }
+
+  s.lru.splice( s.lru.begin(), s.lru, i->second.lru );
+
+  hit.bytes   = i->second.bytes;
+  hit.date_at = i->second.date_at;
+  return true;
+}
+
+void http_cache::store( http_route *route, const http_request& req, uint64_t hash, const string& key, const string& bytes ) {
+  size_t size  = key.size() + bytes.size() + kEntryOverhead,
+         limit = max_bytes / n_shards;
+
+  if( size > limit ) {
+    log( DEBUG, "Response for %s is too big to be cached (%lu bytes).", req.path.c_str(), bytes.size() );
+    return;
+  }
+
+  http_cached_t frozen = freeze( bytes );
+
+  _used.store( true, std::memory_order_relaxed );
+
+  {
+    uint64_t rh = route_hash( req );
+    shard_t& s  = shard( rh );
+    std::lock_guard<std::mutex> lock( s.mutex );
+
+    if( s.routes.size() >= max_known_routes ) {
+      s.routes.clear();
+    }
+    s.routes[rh] = route;
+  }
+
+  shard_t& s = shard( hash );
+  std::lock_guard<std::mutex> lock( s.mutex );
+
+  auto i = s.entries.find( hash );
+  if( i != s.entries.end() ) {
+    evict( s, i );
+  }
+
+  while( s.size + size > limit && !s.lru.empty() ) {
+    evict( s, s.entries.find( s.lru.back() ) );
+  }
+
+  s.lru.push_front( hash );
+
+  entry_t& entry = s.entries[hash];
+  entry.key     = key;
+  entry.bytes   = frozen.bytes;
+  entry.date_at = frozen.date_at;
+  entry.expires = coarse_clock::now() + route->cache_ttl;
+  entry.lru     = s.lru.begin();
+
+  s.size += size;
+}
+
+void http_cache::clear() {
+  for( unsigned int i = 0; i < n_shards; ++i ) {
+    std::lock_guard<std::mutex> lock( _shards[i].mutex );
+
+    _shards[i].entries.clear();
+    _shards[i].lru.clear();
+    _shards[i].routes.clear();
+    _shards[i].size = 0;
+  }
+}
+
+}
@@ -0,0 +1,127 @@
+/*
+ * This file is part of librestd.
+ *
+ * Copyleft of Simone Margaritelli aka evilsocket <evilsocket@protonmail.com>
+ *
+ * librestd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * librestd is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with librestd.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "http_coalescer.h"
+#include "http_route.h"
+#include "http_job.h"
+#include "scheduler.h"
+#include "log.h"
+
+#include <memory>
+
+namespace restd {
+
+bool http_coalescer::join( http_job *job ) {
+  static thread_local string key;
+
+  if( !job->route || !job->route->coalesced || job->request.method != GET || job->_solo ) {
+    return false;
+  }
+
+  uint64_t                    hash = http_cache::key( job->route, job->request, ENCODING_IDENTITY, key );
+  std::lock_guard<std::mutex> lock( _mutex );
+
+  auto i = _flights.find( hash );
+  if( i == _flights.end() ) {
+    flight_t& flight = _flights[hash];
+
+    flight.key   = key;
+    job->_leader = true;
+    job->_flight = hash;
+    return false;
+  }
+  // hash collision with a different request, don't wait on it.
+  else if( i->second.key != key ) {
+    return false;
+  }
+
+  log( DEBUG, "Parking '%s' on its flight.", job->request.path.c_str() );
+
+  i->second.waiters.push_back( job );
+  return true;
+}
+
+bool http_coalescer::shareable( const http_job *leader ) {
+  const http_response& response = leader->response;
+
+  // generators can't be run twice and failed handlers get another chance.
+  if( leader->_failed || response.is_streaming() ) {
+    return false;
+  }
+
+  return ( response.status >= 200 && response.status < 300 ) || response.status == http_response::HTTP_STATUS_NOT_MODIFIED;
+}
+
+void http_coalescer::land( http_job *leader ) {
+  std::list<http_job *> waiters;
+
+  // once out of the map nobody else can join.
+  {
+    std::lock_guard<std::mutex> lock( _mutex );
+
+    auto i = _flights.find( leader->_flight );
+    waiters.swap( i->second.waiters );
+    _flights.erase( i );
+  }
+
+  leader->_leader = false;
+  if( waiters.empty() ) {
+    return;
+  }
+
+  std::shared_ptr<const http_response> shared;
+  http_response&                       response = leader->response;
+
+  // JSON streams refer to the leader's request, only their output is shared.
+  if( shareable( leader ) ) {
+    try {
+      response.flatten();
+      shared = std::make_shared<const http_response>( response );
+    }
+    catch( const std::exception& e ) {
+      log( WARNING, "Could not share response of '%s': %s", leader->request.path.c_str(), e.what() );
+    }
+  }
+
+  for( auto i = waiters.begin(), e = waiters.end(); i != e; ++i ){
+    http_job *job = *i;
+    task_t    task;
+
+    if( shared ) {
+      task = [job, shared]() {
+        job->response = *shared;
+        job->respond();
+        delete job;
+      };
+    }
+    else {
+      job->_solo = true;
+      task = [this, job]() {
+        _retry( job );
+      };
+    }
+
+    // bulkhead and blocking pool threads are not workers, running the
+    // waiters right there would hold them for the whole flight.
+    if( scheduler::current() != _pool || !scheduler::spawn_local( task ) ) {
+      _pool->submit( std::move(task) );
+    }
+  }
+}
+
+}
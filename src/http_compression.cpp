@@ -0,0 +1,380 @@
+/*
+ * This file is part of librestd.
+ *
+ * Copyleft of Simone Margaritelli aka evilsocket <evilsocket@protonmail.com>
+ *
+ * librestd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * librestd is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with librestd.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "http_compression.h"
+#include "log.h"
+
+#include <charconv>
+
+#ifdef RESTD_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+namespace restd {
+
+#ifdef RESTD_HAVE_ZLIB
+
+static inline int window_bits( ContentEncoding encoding ) {
+  // +16 makes zlib write a gzip header and trailer instead of its own.
+  return encoding == ENCODING_GZIP ? 15 + 16 : 15;
+}
+
+// One-shot compressions reuse a per thread z_stream, initializing one
+// allocates a few hundred KB of state.
+class deflate_state
+{
+  public:
+
+    z_stream stream;
+    bool     ready;
+    int      level;
+
+    deflate_state() : ready(false), level(0) {
+      memset( &stream, 0, sizeof(stream) );
+    }
+
+    ~deflate_state() {
+      if( ready ) {
+        deflateEnd( &stream );
+      }
+    }
+
+    z_stream *get( ContentEncoding encoding, int level ) {
+      if( ready && this->level == level ) {
+        deflateReset( &stream );
+        return &stream;
+      }
+
+      if( ready ) {
+        deflateEnd( &stream );
+      }
+
+      memset( &stream, 0, sizeof(stream) );
+      ready = deflateInit2( &stream, level, Z_DEFLATED, window_bits(encoding), 8, Z_DEFAULT_STRATEGY ) == Z_OK;
+      this->level = level;
+
+      return ready ? &stream : NULL;
+    }
+};
+
+#endif
+
+http_deflater::http_deflater( ContentEncoding encoding, int level ) : _stream(NULL), _ok(false) {
+#ifdef RESTD_HAVE_ZLIB
+  z_stream *zs = new z_stream;
+  memset( zs, 0, sizeof(z_stream) );
+
+  if( deflateInit2( zs, level, Z_DEFLATED, window_bits(encoding), 8, Z_DEFAULT_STRATEGY ) == Z_OK ) {
+    _stream = zs;
+    _ok     = true;
+  } else {
+    log( ERROR, "deflateInit2 failed." );
+    delete zs;
+  }
+#endif
+}
+
+http_deflater::~http_deflater() {
+#ifdef RESTD_HAVE_ZLIB
+  if( _stream ) {
+    deflateEnd( (z_stream *)_stream );
+    delete (z_stream *)_stream;
+  }
+#endif
+}
+
+bool http_deflater::run( const char *data, size_t size, int flush, std::string& out ) {
+#ifdef RESTD_HAVE_ZLIB
+  if( !_ok ) {
+    return false;
+  }
+
+  z_stream *zs = (z_stream *)_stream;
+
+  zs->next_in  = (Bytef *)data;
+  zs->avail_in = size;
+
+  do {
+    size_t at   = out.size(),
+           room = deflateBound( zs, zs->avail_in ) + 64;
+
+    out.resize( at + room );
+
+    zs->next_out  = (Bytef *)&out[at];
+    zs->avail_out = room;
+
+    int ret = deflate( zs, flush );
+    out.resize( at + room - zs->avail_out );
+
+    if( ret == Z_STREAM_ERROR ) {
+      log( ERROR, "deflate failed." );
+      _ok = false;
+      return false;
+    }
+    // with no input left and some room left zlib is done for this call.
+  } while( zs->avail_in > 0 || zs->avail_out == 0 );
+
+  return true;
+#else
+  return false;
+#endif
+}
+
+bool http_deflater::write( const char *data, size_t size, std::string& out ) {
+#ifdef RESTD_HAVE_ZLIB
+  return run( data, size, Z_NO_FLUSH, out );
+#else
+  return false;
+#endif
+}
+
+bool http_deflater::flush( std::string& out ) {
+#ifdef RESTD_HAVE_ZLIB
+  return run( NULL, 0, Z_SYNC_FLUSH, out );
+#else
+  return false;
+#endif
+}
+
+bool http_deflater::finish( std::string& out ) {
+#ifdef RESTD_HAVE_ZLIB
+  return run( NULL, 0, Z_FINISH, out );
+#else
+  return false;
+#endif
+}
+
+http_compression::http_compression() :
+  _cache_bytes(0),
+  min_size(1024),
+  level(6),
+  content_types({ "text/", "application/json", "application/javascript", "application/xml", "image/svg+xml" }),
+  cache_max_bytes(16 * 1024 * 1024) {
+
+}
+
+bool http_compression::available() {
+#ifdef RESTD_HAVE_ZLIB
+  return true;
+#else
+  return false;
+#endif
+}
+
+const char *http_compression::name( ContentEncoding encoding ) {
+  switch( encoding ) {
+    case ENCODING_GZIP:    return "gzip";
+    case ENCODING_DEFLATE: return "deflate";
+    default:               return "identity";
+  }
+}
+
+ContentEncoding http_compression::negotiate( const http_request& req, bool& identity ) {
+  identity = true;
+
+  auto h = req.headers.find("Accept-Encoding");
+  if( h == req.headers.end() ) {
+    return ENCODING_IDENTITY;
+  }
+
+  // quality of each coding, negative if not listed.
+  double gzip     = -1.0,
+         deflate  = -1.0,
+         plain    = -1.0,
+         wildcard = -1.0;
+  std::string_view value = h->second;
+
+  // gzip, deflate;q=0.5, br;q=0
+  while( !value.empty() ) {
+    size_t comma = value.find(',');
+    std::string_view token = value.substr( 0, comma );
+    value = comma == std::string_view::npos ? std::string_view() : value.substr( comma + 1 );
+
+    size_t semi = token.find(';');
+    std::string_view coding = token.substr( 0, semi ),
+                     params = semi == std::string_view::npos ? std::string_view() : token.substr( semi + 1 );
+
+    while( !coding.empty() && isspace( coding.front() ) ) coding.remove_prefix(1);
+    while( !coding.empty() && isspace( coding.back() ) ) coding.remove_suffix(1);
+
+    // q=0 means "not acceptable".
+    double qvalue = 1.0;
+    size_t q      = params.find("q=");
+    if( q != std::string_view::npos ) {
+      std::from_chars( params.data() + q + 2, params.data() + params.size(), qvalue );
+    }
+
+    if( coding == "gzip" || coding == "x-gzip" ) {
+      gzip = qvalue;
+    }
+    else if( coding == "deflate" ) {
+      deflate = qvalue;
+    }
+    else if( coding == "identity" ) {
+      plain = qvalue;
+    }
+    else if( coding == "*" ) {
+      wildcard = qvalue;
+    }
+  }
+
+  // the wildcard only stands for the codings that aren't listed.
+  if( gzip < 0.0 ) {
+    gzip = wildcard;
+  }
+  if( deflate < 0.0 ) {
+    deflate = wildcard;
+  }
+  if( plain < 0.0 ) {
+    plain = wildcard;
+  }
+
+  // identity is acceptable unless explicitly refused, either by name or by
+  // a zero wildcard.
+  identity = plain != 0.0;
+
+  if( !available() ) {
+    return ENCODING_IDENTITY;
+  }
+
+  // the highest quality wins, ties go to gzip, then to compressing at all.
+  ContentEncoding best = ENCODING_GZIP;
+  double          bestq = gzip;
+
+  if( deflate > bestq ) {
+    best  = ENCODING_DEFLATE;
+    bestq = deflate;
+  }
+
+  if( bestq <= 0.0 || plain > bestq ) {
+    return ENCODING_IDENTITY;
+  }
+
+  return best;
+}
+
+void http_compression::vary( http_response& resp ) {
+  auto i = resp.headers.find("Vary");
+  if( i == resp.headers.end() || i->second.empty() ) {
+    resp.headers["Vary"] = "Accept-Encoding";
+  }
+  else if( i->second.find("Accept-Encoding") == string::npos && i->second != "*" ) {
+    i->second += ", Accept-Encoding";
+  }
+}
+
+bool http_compression::compressible( const http_response& resp, size_t size ) const {
+  if( size != 0 && size < min_size ) {
+    return false;
+  }
+
+  if( resp.headers.find("Content-Encoding") != resp.headers.end() ) {
+    return false;
+  }
+
+  auto ct = resp.headers.find("Content-Type");
+  if( ct == resp.headers.end() ) {
+    return false;
+  }
+
+  for( auto i = content_types.begin(), e = content_types.end(); i != e; ++i ) {
+    if( ct->second.compare( 0, i->size(), *i ) == 0 ) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+bool http_compression::compress( ContentEncoding encoding, std::string_view data, std::string& out ) const {
+#ifdef RESTD_HAVE_ZLIB
+  static thread_local deflate_state states[3];
+
+  z_stream *zs = states[encoding].get( encoding, level );
+  if( zs == NULL ) {
+    log( ERROR, "deflateInit2 failed." );
+    return false;
+  }
+
+  size_t at    = out.size(),
+         bound = deflateBound( zs, data.size() );
+
+  out.resize( at + bound );
+
+  zs->next_in   = (Bytef *)data.data();
+  zs->avail_in  = data.size();
+  zs->next_out  = (Bytef *)&out[at];
+  zs->avail_out = bound;
+
+  if( deflate( zs, Z_FINISH ) != Z_STREAM_END ) {
+    log( ERROR, "deflate failed." );
+    out.resize( at );
+    return false;
+  }
+
+  out.resize( at + bound - zs->avail_out );
+  return true;
+#else
+  return false;
+#endif
+}
+
+std::shared_ptr<const std::string> http_compression::compress_cached( ContentEncoding encoding, std::string_view data ) {
+  uint64_t key = strings::hash( data.data(), data.size(), strings::hash( (const char *)&encoding, sizeof(encoding) ) );
+  key = strings::hash( (const char *)&key, sizeof(key), data.size() );
+  // a second, unrelated hash makes a collision of both practically
+  // impossible, so hits don't need to compare the bodies.
+  size_t check = std::hash<std::string_view>()( data );
+
+  {
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    auto i = _cache.find(key);
+    if( i != _cache.end() && i->second->check == check && i->second->size == data.size() ) {
+      _lru.splice( _lru.begin(), _lru, i->second );
+      return i->second->data;
+    }
+  }
+
+  auto compressed = std::make_shared<std::string>();
+  if( compress( encoding, data, *compressed ) == false ) {
+    return NULL;
+  }
+
+  std::unique_lock<std::mutex> lock(_mutex);
+
+  size_t size = compressed->size();
+
+  if( _cache.find(key) == _cache.end() && size <= cache_max_bytes ) {
+    _lru.push_front( cache_entry_t{ key, check, data.size(), compressed } );
+    _cache[key]   = _lru.begin();
+    _cache_bytes += size;
+
+    while( _cache_bytes > cache_max_bytes ) {
+      cache_entry_t& last = _lru.back();
+
+      _cache_bytes -= last.data->size();
+      _cache.erase( last.key );
+      _lru.pop_back();
+    }
+  }
+
+  return compressed;
+}
+
+}
@@ -0,0 +1,448 @@
+/*
+ * This file is part of librestd.
+ *
+ * Copyleft of Simone Margaritelli aka evilsocket <evilsocket@protonmail.com>
+ *
+ * librestd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * librestd is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with librestd.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "http_job.h"
+#include "http_route.h"
+#include "http_server.h"
+#include "http_stream.h"
+#include "http_sse.h"
+#include "log.h"
+#include "strings.h"
+
+#include <charconv>
+
+namespace restd {
+
+// per thread scratch space for serialized JSON bodies.
+static thread_local string body_buffer;
+
+http_job::http_job( tcp_stream *client ) : 
+  _materialized(false), 
+  _cache_hash(0), 
+  _leader(false),
+  _flight(0),
+  _solo(false),
+  _failed(false),
+  _identity(true),
+  client(client), 
+  route(NULL), 
+  compression(NULL), 
+  cache(NULL),
+  coalescer(NULL),
+  server(NULL),
+  priority(PRIORITY_NORMAL),
+  flow(0),
+  queue(NULL) {
+
+}
+
+http_job::~http_job() {
+  // never responded, waiters run the handler themselves.
+  if( _leader ) {
+    _failed = true;
+    coalescer->land( this );
+  }
+  delete client;
+  // dropped without a response.
+  charge();
+
+  if( server ) {
+    server->release();
+  }
+}
+
+bool http_job::from_cache() {
+  // conditional requests go through the handler to be revalidated.
+  if( !cache || request.method != GET || request.has_header("If-None-Match") ) {
+    return false;
+  }
+
+  http_route *known = cache->route_for( request );
+  if( !known ) {
+    return false;
+  }
+
+  ContentEncoding encoding = negotiate();
+  http_cached_t   hit;
+
+  if( encoding == ENCODING_IDENTITY && !_identity ) {
+    return false;
+  }
+
+  _cache_hash = http_cache::key( known, request, encoding, _cache_key );
+  if( cache->lookup( _cache_hash, _cache_key, hit ) == false ) {
+    // only this route's own pattern needs to be checked.
+    if( known->matches( request ) ) {
+      route = known;
+    }
+    return false;
+  }
+
+  send( hit, "cached" );
+  return true;
+}
+
+void http_job::send( const http_cached_t& frozen, const char *what ) {
+  const string& bytes = *frozen.bytes;
+
+  log( INFO, "%s > \"%s %s\" %s %lu", 
+       client->peer_address().c_str(), 
+       request.method_name().c_str(),
+       request.path.c_str(),
+       what,
+       bytes.size() );
+
+  ssize_t sent = http_cache::send( client, frozen );
+  if( sent != (ssize_t)bytes.size() ){
+    log( ERROR, "Could not send whole response, sent %ld out of %lu bytes.", sent, bytes.size() );
+  }
+}
+
+ContentEncoding http_job::negotiate() {
+  ContentEncoding encoding = http_compression::negotiate( request, _identity );
+  return compression ? encoding : ENCODING_IDENTITY;
+}
+
+void http_job::respond_prebuilt() {
+  ContentEncoding encoding = negotiate();
+
+  if( !route->prebuilt[encoding].bytes || ( _identity && !route->prebuilt_preferred ) ) {
+    encoding = ENCODING_IDENTITY;
+  }
+
+  // only the plain bytes are there and the client doesn't want them.
+  if( encoding == ENCODING_IDENTITY && !_identity ) {
+    response.not_acceptable();
+    respond();
+    return;
+  }
+
+  send( route->prebuilt[encoding], "prebuilt" );
+}
+
+void http_job::charge() {
+  if( queue ) {
+    queue->charge( priority, flow, std::chrono::steady_clock::now() - popped );
+    queue = NULL;
+  }
+}
+
+void http_job::store( const string& serialized, ContentEncoding encoding ) {
+  if( !cache || !route || route->cache_ttl == 0 || request.method != GET || 
+      response.status != http_response::HTTP_STATUS_OK || response.is_streaming() || response.is_subscription() ||
+      request.has_header("If-None-Match") ) {
+    return;
+  }
+
+  if( _cache_key.empty() ) {
+    _cache_hash = http_cache::key( route, request, encoding, _cache_key );
+  }
+
+  cache->store( route, request, _cache_hash, _cache_key, serialized );
+}
+
+void http_job::fail( const char *what, const std::exception& e ) {
+  log( ERROR, "Exception while %s '%s': %s", what, request.path.c_str(), e.what() );
+
+  response      = http_response( http_response::HTTP_STATUS_INTERNAL, "Internal Server Error" );
+  _materialized = false;
+  _failed       = true;
+}
+
+void http_job::process() {
+  try {
+    if( route ) {
+      route->call( request, response );
+    }
+    else {
+      response.not_found();
+    }
+  }
+  catch( const std::exception& e ) {
+    fail( "handling", e );
+  }
+}
+
+#if defined(__cpp_impl_coroutine)
+static detached run_async( http_job *job ) {
+  try {
+    co_await job->route->async_handler( job->request, job->response );
+  }
+  catch( const std::exception& e ) {
+    job->fail( "handling", e );
+  }
+
+  job->respond();
+  delete job;
+}
+#endif
+
+void http_job::process_async() {
+#if defined(__cpp_impl_coroutine)
+  run_async( this );
+#else
+  process();
+  respond();
+  delete this;
+#endif
+}
+
+void http_job::stream( ContentEncoding encoding ) {
+  http_stream_writer writer( client, encoding, compression ? compression->level : 0 );
+
+  try {
+    while( writer.ok() && response.generator( writer ) ) ;
+  }
+  catch( const std::exception& e ) {
+    // headers are gone already, just truncate the body.
+    log( ERROR, "Exception while streaming '%s': %s", request.path.c_str(), e.what() );
+    return;
+  }
+
+  writer.finish();
+
+  log( DEBUG, "Streamed %lu bytes to %s.", writer.sent(), client->peer_address().c_str() );
+}
+
+std::string_view http_job::materialize() {
+  if( !_materialized ) {
+    _materialized = true;
+    _body = response.body;
+
+    if( response.has_json_body() ) {
+      body_buffer.clear();
+      response.write_body( body_buffer );
+      _body = body_buffer;
+    }
+  }
+  return _body;
+}
+
+// "a", W/"b", "c" -> true if any of them matches etag, weak comparison.
+static bool etag_matches( std::string_view list, std::string_view etag ) {
+  if( etag.substr( 0, 2 ) == "W/" ) {
+    etag.remove_prefix(2);
+  }
+
+  while( !list.empty() ) {
+    size_t comma = list.find(',');
+    std::string_view token = list.substr( 0, comma );
+    list = comma == std::string_view::npos ? std::string_view() : list.substr( comma + 1 );
+
+    while( !token.empty() && isspace( token.front() ) ) token.remove_prefix(1);
+    while( !token.empty() && isspace( token.back() ) ) token.remove_suffix(1);
+
+    if( token.substr( 0, 2 ) == "W/" ) {
+      token.remove_prefix(2);
+    }
+
+    if( token == "*" || token == etag ) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+bool http_job::revalidate() {
+  if( request.method != GET || response.status != http_response::HTTP_STATUS_OK ) {
+    return false;
+  }
+
+  auto tag = response.headers.find("ETag");
+  if( tag == response.headers.end() ) {
+    std::string_view body = materialize();
+    char             buf[20] = { '"' };
+    auto             r = std::to_chars( buf + 1, buf + sizeof(buf) - 1, strings::hash( body.data(), body.size() ), 16 );
+
+    *r.ptr++ = '"';
+    tag = response.headers.emplace( "ETag", string( buf, r.ptr - buf ) ).first;
+  }
+
+  auto inm = request.headers.find("If-None-Match");
+  if( inm == request.headers.end() || etag_matches( inm->second, tag->second ) == false ) {
+    return false;
+  }
+
+  response.not_modified();
+  return true;
+}
+
+bool http_job::compress( ContentEncoding encoding, std::string& out, size_t& body_size, bool forced ) {
+  static thread_local string zip_buffer;
+  std::string_view body = materialize();
+
+  if( !forced && compression->compressible( response, body.size() ) == false ) {
+    if( response.has_json_body() ) {
+      body_size = response.serialize( out, body );
+      return true;
+    }
+    return false;
+  }
+
+  std::shared_ptr<const string> cached;
+  std::string_view              zipped;
+
+  if( route && route->cache_compressed ) {
+    if( !( cached = compression->compress_cached( encoding, body ) ) ) {
+      return false;
+    }
+    zipped = *cached;
+  }
+  else {
+    zip_buffer.clear();
+    if( compression->compress( encoding, body, zip_buffer ) == false ) {
+      return false;
+    }
+    zipped = zip_buffer;
+  }
+
+  response.headers["Content-Encoding"] = http_compression::name(encoding);
+
+  // the bytes differ from the identity ones, so a strong tag would lie.
+  auto tag = response.headers.find("ETag");
+  if( tag != response.headers.end() && tag->second[0] == '"' ) {
+    tag->second.insert( 0, "W/" );
+  }
+
+  body_size = response.serialize( out, zipped );
+
+  if( zip_buffer.capacity() > max_buffer_size ) {
+    string().swap( zip_buffer );
+  }
+
+  return true;
+}
+
+size_t http_job::serialize( string& out, ContentEncoding& encoding ) {
+  size_t body_size = 0;
+
+  if( route && route->with_etag && !response.is_streaming() && !response.is_subscription() && revalidate() ) {
+    encoding = ENCODING_IDENTITY;
+  }
+
+  // the client refused an uncompressed body: whatever it is gets compressed,
+  // or it's a 406. Event streams are never compressed, empty bodies and
+  // bodies that are encoded already have nothing to compress.
+  bool forced = !_identity && !response.is_subscription() &&
+                response.status != http_response::HTTP_STATUS_NOT_ACCEPTABLE &&
+                response.status != http_response::HTTP_STATUS_NOT_MODIFIED &&
+                response.status != http_response::HTTP_STATUS_NO_CONTENT &&
+                response.headers.find("Content-Encoding") == response.headers.end();
+
+  // identity responses of compressible content vary too, or shared caches
+  // would hand them to clients asking for a compressed one and vice versa.
+  if( compression && !response.is_subscription() && ( forced || compression->compressible( response, 0 ) ) ) {
+    http_compression::vary( response );
+  }
+
+  if( response.is_subscription() ) {
+    encoding = ENCODING_IDENTITY;
+    response.serialize( out );
+  }
+  else if( response.is_streaming() && ( encoding != ENCODING_IDENTITY || !forced ) ) {
+    if( encoding != ENCODING_IDENTITY && ( forced || compression->compressible( response, 0 ) ) ) {
+      response.headers["Content-Encoding"] = http_compression::name(encoding);
+    } else {
+      encoding = ENCODING_IDENTITY;
+    }
+
+    response.serialize( out );
+  }
+  else if( encoding == ENCODING_IDENTITY || compress( encoding, out, body_size, forced ) == false ) {
+    encoding = ENCODING_IDENTITY;
+
+    if( forced ) {
+      response = http_response();
+      response.not_acceptable();
+      if( compression ) {
+        http_compression::vary( response );
+      }
+      body_size = response.serialize( out );
+    }
+    // don't serialize a JSON body twice if the ETag needed it already.
+    else if( _materialized && response.has_json_body() ) {
+      body_size = response.serialize( out, _body );
+    } else {
+      body_size = response.serialize( out );
+    }
+  }
+
+  return body_size;
+}
+
+void http_job::respond() {
+  // each worker thread serializes into its own buffer, reused across requests.
+  static thread_local string res_buffer;
+  ContentEncoding encoding = negotiate();
+  size_t          body_size = 0;
+
+  // identical requests parked meanwhile get the same response.
+  if( _leader ) {
+    coalescer->land( this );
+  }
+
+  res_buffer.clear();
+
+  try {
+    body_size = serialize( res_buffer, encoding );
+  }
+  catch( const std::exception& e ) {
+    // JSON streams are user code too.
+    fail( "serializing", e );
+
+    res_buffer.clear();
+    encoding  = ENCODING_IDENTITY;
+    body_size = response.serialize( res_buffer );
+  }
+
+  store( res_buffer, encoding );
+
+  log( INFO, "%s > \"%s %s\" %d %lu", 
+       client->peer_address().c_str(), 
+       request.method_name().c_str(),
+       request.path.c_str(),
+       response.status,
+       body_size );
+
+  int sent = client->send( (unsigned char *)res_buffer.c_str(), res_buffer.size() );
+  if( sent != res_buffer.size() ){
+    log( ERROR, "Could not send whole response, sent %d out of %lu bytes.", sent, res_buffer.size() );
+  }
+  else if( response.is_streaming() ) {
+    stream( encoding );
+  }
+  else if( response.is_subscription() ) {
+    // the channel owns the connection from now on.
+    response.channel->subscribe( client, server );
+    client = NULL;
+  }
+
+  // wherever the handler ran, it's done with the client's share now.
+  charge();
+
+  // don't keep huge buffers around because of a single big response.
+  if( res_buffer.capacity() > max_buffer_size ) {
+    string().swap( res_buffer );
+  }
+  if( body_buffer.capacity() > max_buffer_size ) {
+    string().swap( body_buffer );
+  }
+}
+
+}
@@ -0,0 +1,151 @@
+/*
+ * This file is part of librestd.
+ *
+ * Copyleft of Simone Margaritelli aka evilsocket <evilsocket@protonmail.com>
+ *
+ * librestd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * librestd is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with librestd.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "http_priority.h"
+#include "http_job.h"
+
+namespace restd {
+
+http_priority_queue::http_priority_queue() : _strict(false), _quantum(1000000) {
+  weights( 8, 4, 1 );
+}
+
+void http_priority_queue::weights( unsigned int high, unsigned int normal, unsigned int low ) {
+  std::lock_guard<std::mutex> lock(_mutex);
+
+  // a lane with no weight would hold its requests forever.
+  _weights[PRIORITY_HIGH]   = high ? high : 1;
+  _weights[PRIORITY_NORMAL] = normal ? normal : 1;
+  _weights[PRIORITY_LOW]    = low ? low : 1;
+
+  for( unsigned int i = 0; i < n_priorities; ++i ) {
+    _credits[i] = _weights[i];
+  }
+}
+
+void http_priority_queue::strict( bool enabled /* = true */ ) {
+  std::lock_guard<std::mutex> lock(_mutex);
+  _strict = enabled;
+}
+
+void http_priority_queue::quantum( std::chrono::microseconds quantum ) {
+  std::lock_guard<std::mutex> lock(_mutex);
+  _quantum = std::chrono::duration_cast<std::chrono::nanoseconds>( quantum ).count();
+  if( _quantum <= 0 ) {
+    _quantum = 1;
+  }
+}
+
+void http_priority_queue::push( http_job *job ) {
+  std::lock_guard<std::mutex> lock(_mutex);
+  lane_t& lane = _lanes[job->priority];
+
+  auto i = lane.flows.find( job->flow );
+  if( i == lane.flows.end() ) {
+    i = lane.flows.emplace( job->flow, flow_t() ).first;
+    i->second.deficit = _quantum;
+    i->second.running = 0;
+    i->second.active  = false;
+  }
+
+  i->second.jobs.push_back( job );
+  if( !i->second.active ) {
+    i->second.active = true;
+    lane.active.push_back( job->flow );
+  }
+}
+
+http_job *http_priority_queue::pop( lane_t& lane ) {
+  while( !lane.active.empty() ) {
+    uint64_t key = lane.active.front();
+    auto     i   = lane.flows.find( key );
+    flow_t&  f   = i->second;
+
+    // out of credit, its next quantum will come at its next turn.
+    if( f.deficit <= 0 ) {
+      f.deficit += _quantum;
+      lane.active.splice( lane.active.end(), lane.active, lane.active.begin() );
+      continue;
+    }
+
+    http_job *job = f.jobs.front();
+    f.jobs.pop_front();
+    f.running++;
+
+    if( f.jobs.empty() ) {
+      f.active = false;
+      lane.active.pop_front();
+    }
+
+    return job;
+  }
+
+  return NULL;
+}
+
+http_job *http_priority_queue::pop() {
+  std::lock_guard<std::mutex> lock(_mutex);
+
+  for( int round = 0; round < 2; ++round ) {
+    for( unsigned int i = 0; i < n_priorities; ++i ) {
+      if( _lanes[i].active.empty() || ( !_strict && _credits[i] == 0 ) ) {
+        continue;
+      }
+
+      if( !_strict ) {
+        _credits[i]--;
+      }
+
+      return pop( _lanes[i] );
+    }
+
+    if( _strict ) {
+      break;
+    }
+
+    // every lane with something to do used its share, new round.
+    for( unsigned int i = 0; i < n_priorities; ++i ) {
+      _credits[i] = _weights[i];
+    }
+  }
+
+  return NULL;
+}
+
+void http_priority_queue::charge( Priority priority, uint64_t flow, std::chrono::nanoseconds used ) {
+  std::lock_guard<std::mutex> lock(_mutex);
+  lane_t& lane = _lanes[priority];
+
+  auto i = lane.flows.find( flow );
+  if( i == lane.flows.end() ) {
+    return;
+  }
+
+  i->second.running--;
+  i->second.deficit -= used.count();
+  if( i->second.deficit < -max_debt * _quantum ) {
+    i->second.deficit = -max_debt * _quantum;
+  }
+
+  // idle flows are forgotten, their credit or debt with them.
+  if( i->second.jobs.empty() && i->second.running == 0 ) {
+    lane.flows.erase( i );
+  }
+}
+
+}
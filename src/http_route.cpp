@@ -19,35 +19,73 @@
 #include "http_route.h"
 #include "log.h"
 
+#include <algorithm>
+
 namespace restd {
 
-const static std::regex kNamedParamParser( ":([_a-z0-9]+)\\(([^\\)]*)\\)", std::regex_constants::icase );
+// :name(validator) or :name<type>
+const static std::regex kNamedParamParser( ":([_a-z0-9]+)(?:\\(([^\\)]*)\\)|<([_a-z0-9]+)>)", std::regex_constants::icase );
+
+typedef struct {
+  const char       *name;
+  const char       *expr;
+  param_validator_t validator;
+}
+param_type_t;
+
+// Typed parameters are validated while matching, so the handler can
+// parse them again with http_request::param<T> knowing they're valid.
+static const param_type_t kParamTypes[] = {
+  { "int",  "-?[0-9]+", validate_param<int64_t> },
+  { "uint", "[0-9]+", validate_param<uint64_t> },
+  { "uuid", "[a-fA-F0-9]{8}-[a-fA-F0-9]{4}-[a-fA-F0-9]{4}-[a-fA-F0-9]{4}-[a-fA-F0-9]{12}", validate_param<uuid> },
+  { "str",  "[^/]+", NULL }
+};
 
-http_route::http_route( string path, http_controller *controller, http_controller::handler_t handler, unsigned int methods /* = ANY */ ) :
-  is_re(false),
-  re_expected(0),
-  methods(methods),
-  path(path),
-  controller(controller),
-  handler(handler){
+static const param_type_t *find_param_type( const string& name ) {
+  for( size_t i = 0; i < sizeof(kParamTypes) / sizeof(kParamTypes[0]); ++i ) {
+    if( name == kParamTypes[i].name ) {
+      return &kParamTypes[i];
+    }
+  }
+  return NULL;
+}
 
+void http_route::compile() {
+  string path = this->path;
   std::smatch m;
-  while( std::regex_search( path, m, kNamedParamParser ) == true && m.size() == 3 ) {
+  while( std::regex_search( path, m, kNamedParamParser ) == true && m.size() == 4 ) {
     string tok  = m[0].str(),
            name = m[1].str(),
            expr = m[2].str();
+    param_validator_t validator = NULL;
+
+    if( m[3].matched ) {
+      const param_type_t *type = find_param_type( m[3].str() );
+      if( type == NULL ) {
+        throw std::invalid_argument( "Unknown type '" + m[3].str() + "' for parameter '" + name + "'." );
+      }
+
+      expr      = type->expr;
+      validator = type->validator;
+    }
 
     log( DEBUG, "  Found named parameter '%s' ( validator='%s' )", name.c_str(), expr.c_str() );
 
     strings::replace( this->path, tok, "(" + expr + ")" );
 
     names.push_back(name);
+    validators.push_back(validator);
 
     is_re = true;
     path = m.suffix();
   }
 
   if(is_re) {
+    if( names.size() > http_request::max_path_params ) {
+      throw std::invalid_argument( "Too many named parameters in route '" + this->path + "'." );
+    }
+
     log( DEBUG, " Named route expression: '%s'", this->path.c_str() );
     re_expected = names.size() + 1;
     re = std::regex( this->path, std::regex_constants::icase );
@@ -63,22 +101,154 @@ bool http_route::matches( http_request& req ) {
   if( is_re == false ) {
     return req.path == path;
   }
-  // check for named parameters regular expression..
-  std::smatch m;
-  if( std::regex_search( req.path, m, re ) == true && m.size() == re_expected ) {
-    // fill parameters inside the request using the tokenized path.
+  // check for named parameters regular expression, the match object
+  // is reused by each worker thread to keep its storage around.
+  static thread_local std::cmatch m;
+  const char *begin = req.path.c_str(),
+             *end   = begin + req.path.size();
+
+  if( std::regex_search( begin, end, m, re ) == false || m.size() != re_expected ) {
+    return false;
+  }
+  // validate typed parameters before touching the request.
+  for( size_t i = 1; i < re_expected; ++i ) {
+    param_validator_t validator = validators[i - 1];
+    if( validator && validator( std::string_view( m[i].first, m[i].length() ) ) == false ) {
+      log( DEBUG, "Parameter '%s' of '%s' failed validation.", names[i - 1].c_str(), req.path.c_str() );
+      return false;
+    }
+  }
+  // point parameters inside the request to the tokenized path.
+  for( size_t i = 1; i < re_expected; ++i ) {
+    req.path_params[i - 1].name  = names[i - 1].c_str();
+    req.path_params[i - 1].value = std::string_view( m[i].first, m[i].length() );
+  }
+  req.n_path_params = re_expected - 1;
+  // what handlers written before path_params rely on.
+  if( copy_params ) {
     for( size_t i = 1; i < re_expected; ++i ) {
-      req.parameters[ names[i - 1] ] = m[i].str();
+      req.parameters[ names[i - 1] ].assign( m[i].first, m[i].length() );
     }
+  }
+
+  return true;
+}
+
+http_router::~http_router() {
+  for( auto i = _routes.begin(), e = _routes.end(); i != e; ++i ){
+    delete (*i);
+  }
 
-    return true;
+  _routes.clear();
+
+  for( auto v = _vhosts.begin(), ve = _vhosts.end(); v != ve; ++v ){
+    for( auto i = v->second.routes.begin(), e = v->second.routes.end(); i != e; ++i ){
+      delete (*i);
+    }
   }
 
-  return false;
+  _vhosts.clear();
 }
 
-void http_route::call( http_request& req, http_response& resp ) {
-  (controller->*handler)( req, resp );
+// name is already lowercase.
+static bool host_equals( const string& name, const string& host, size_t len ) {
+  if( name.size() != len ) {
+    return false;
+  }
+
+  for( size_t i = 0; i < len; ++i ) {
+    if( name[i] != tolower( (unsigned char)host[i] ) ) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+uint64_t http_router::host_hash( const string& host, size_t& len ) {
+  size_t end = string::npos;
+  // [::1]:8080 vs example.com:8080
+  if( !host.empty() && host[0] == '[' ) {
+    end = host.find(']');
+    if( end != string::npos ) {
+      ++end;
+    }
+  } else {
+    end = host.find(':');
+  }
+
+  len = end == string::npos ? host.size() : end;
+
+  uint64_t h = strings::fnv_offset;
+  for( size_t i = 0; i < len; ++i ) {
+    char c = tolower( (unsigned char)host[i] );
+    h = strings::hash( &c, 1, h );
+  }
+  return h;
+}
+
+http_route *http_router::add( const string& host, http_route *route ) {
+  if( host.empty() ) {
+    _routes.push_back(route);
+    return route;
+  }
+
+  size_t   len   = 0;
+  uint64_t h     = host_hash( host, len );
+  auto     range = _vhosts.equal_range(h);
+
+  for( auto i = range.first; i != range.second; ++i ){
+    if( host_equals( i->second.host, host, len ) ) {
+      i->second.routes.push_back(route);
+      return route;
+    }
+  }
+
+  vhost_t vh;
+
+  vh.host = host.substr( 0, len );
+  std::transform( vh.host.begin(), vh.host.end(), vh.host.begin(), []( unsigned char c ) { return (char)tolower(c); } );
+  vh.routes.push_back(route);
+
+  _vhosts.emplace( h, std::move(vh) );
+  return route;
+}
+
+http_route *http_router::match( routes_t& routes, http_request& req ) {
+  for( auto i = routes.begin(), e = routes.end(); i != e; ++i ){
+    http_route *route = *i;
+
+    if( route->matches( req ) ) {
+      log( DEBUG, "'%s %s' matched route.", req.method_name().c_str(), req.path.c_str() );
+      return route;
+    }
+  }
+
+  return NULL;
+}
+
+http_route *http_router::match( http_request& req ) {
+  if( !_vhosts.empty() && !req.host.empty() ) {
+    size_t len   = 0;
+    auto   range = _vhosts.equal_range( host_hash( req.host, len ) );
+
+    for( auto vh = range.first; vh != range.second; ++vh ){
+      if( host_equals( vh->second.host, req.host, len ) ) {
+        http_route *route = match( vh->second.routes, req );
+        if( route ) {
+          return route;
+        }
+        break;
+      }
+    }
+  }
+
+  http_route *route = match( _routes, req );
+  if( route == NULL ) {
+    log( WARNING, "No route defined for '%s %s'", req.method_name().c_str(), req.path.c_str() );
+  }
+
+  return route;
 }
 
 }
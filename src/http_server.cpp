@@ -17,37 +17,22 @@
  * along with librestd.  If not, see <http://www.gnu.org/licenses/>.
 */
 #include "http_server.h"
+#include "http_sse.h"
 #include "log.h"
 
-namespace restd {
-
-void http_consumer::route( http_request& request, http_response& response ) {
-  for( auto i = _routes->begin(), e = _routes->end(); i != e; ++i ){
-    http_route *route = *i;
-
-    if( route->matches( request ) ) {
-      log( DEBUG, "'%s %s' matched route.", request.method_name().c_str(), request.path.c_str() );
-      route->call( request, response );
-      return;
-    }
-  }
+#include <stdexcept>
+#include <mutex>
+#include <chrono>
+#include <thread>
 
-  log( WARNING, "No route defined for '%s %s'", request.method_name().c_str(), request.path.c_str() );
-  
-  response.not_found();
-}
+namespace restd {
 
-void http_consumer::consume( tcp_stream *client ) {
+bool http_consumer::read( tcp_stream *client, http_request& request, http_response& response ) {
   unsigned char chunk[ http_request::chunk_size ] = {0};
   int           read = 0,
                 left = 0,
                 toread = 0;
   string        line;
-  http_request  request;
-  http_response response;
-  string        res_buffer;
-  
-  log( DEBUG, "New client connection from %s:%d", client->peer_address().c_str(), client->peer_port() );
 
 #define LOG_FAILED_READ(r) \
     if( r == TCP_ERROR ) { \
@@ -65,19 +50,19 @@ void http_consumer::consume( tcp_stream *client ) {
     int r = client->read_until( (unsigned char)'\n', line, http_request::read_timeout );
     if( r <= 0 ) {
       LOG_FAILED_READ(r)
-      return;
+      return false;
     }
 
     try {
       if( request.parse_line( (const unsigned char *)line.c_str(), line.length() ) == false ) {
         response.bad_request();
-        goto done;
+        return true;
       }
     }
     catch( const std::regex_error& e ){
       log( ERROR, "Exception (%d) while parsing request: %s", e.code(), e.what() );
       response.bad_request();
-      goto done;
+      return true;
     }
 
     if( request.parser_state == PARSE_DONE ) {
@@ -99,7 +84,7 @@ void http_consumer::consume( tcp_stream *client ) {
       read = client->receive( chunk, toread, http_request::read_timeout );
       if( read <= 0 ) {
         LOG_FAILED_READ(read)
-        return;
+        return false;
       }
 
       left -= read;
@@ -111,77 +96,385 @@ void http_consumer::consume( tcp_stream *client ) {
 
     if( request.parse_body() == false ) {
       response.bad_request();
-      goto done;
     }
   }
 
-  route( request, response );
+  return true;
+}
 
-done:
+void http_consumer::consume( tcp_stream *client ) {
+  http_job *job = new http_job(client);
+
+  job->compression = _server->_compress ? &_server->_compression : NULL;
+  job->cache       = &_server->_cache;
+  job->coalescer   = &_server->_coalescer;
+  job->server      = _server;
+
+  if( _server->_shedding && !_server->_shedder.admit( client->accepted_at() ) ) {
+    log( DEBUG, "Shedding client connection from %s:%d, queued for too long.", client->peer_address().c_str(), client->peer_port() );
+    // the request is never read, nor parsed.
+    http_cache::send( client, _server->_shed_response );
+    client->discard();
+    delete job;
+    return;
+  }
 
-  log( INFO, "%s > \"%s %s\" %d %d", 
-       client->peer_address().c_str(), 
-       request.method_name().c_str(),
-       request.path.c_str(),
-       response.status,
-       response.body.size() );
+  log( DEBUG, "New client connection from %s:%d", client->peer_address().c_str(), client->peer_port() );
 
-  res_buffer = response.str();
-  int sent = client->send( (unsigned char *)res_buffer.c_str(), res_buffer.size() );
-  if( sent != res_buffer.size() ){
-    log( ERROR, "Could not send whole response, sent %d out of %lu bytes.", sent, res_buffer.size() );
+  if( read( client, job->request, job->response ) == false ) {
+    delete job;
+    return;
   }
+  // response already set by the parser, most likely a 400.
+  if( job->response.status != http_response::HTTP_STATUS_OK ) {
+    job->respond();
+    delete job;
+    return;
+  }
+
+  if( job->from_cache() ) {
+    delete job;
+    return;
+  }
+
+  if( !job->route ) {
+    job->route = _server->_router.match( job->request );
+  }
+  if( job->route && job->route->is_constant() ) {
+    job->respond_prebuilt();
+    delete job;
+    return;
+  }
+
+  if( _server->_prioritized || _server->_fair ) {
+    if( job->route ) {
+      job->priority = job->route->priority;
+    }
+    if( _server->_classifier ) {
+      job->priority = _server->_classifier( job->request, client, job->priority );
+    }
+    if( _server->_fair ) {
+      job->flow = _server->flow_of( job->request, client );
+    }
+
+    // whoever runs next takes the most urgent job, not necessarily this one,
+    // after parsing what's been accepted meanwhile so it gets a say too.
+    _server->_priorities.push( job );
+    _server->_scheduler.defer( [this]() {
+      dispatch();
+    });
+    return;
+  }
+
+  execute( job );
 }
 
-http_server::http_server( string address, unsigned short port, unsigned int threads ) :
-   _address(address), _port(port), _threads(threads)
-{
-  for( unsigned int i = 0; i < threads; ++i ){
-    _consumers.push_back( new http_consumer(_queue, &_routes) );
+void http_consumer::dispatch() {
+  http_job *job = _server->_priorities.pop();
+  if( job ) {
+    // execute() may just hand the job over to a bulkhead, the blocking pool
+    // or a coroutine, the flow is charged once the response is sent.
+    job->queue  = &_server->_priorities;
+    job->popped = std::chrono::steady_clock::now();
+
+    execute( job );
   }
+}
 
+void http_consumer::execute( http_job *job ) {
+  if( job->route && job->route->offloaded && !job->route->is_async() ) {
+    blocking_pool::shared().submit( [this, job]() {
+      run( job );
+    });
+    return;
+  }
+
+  run( job );
+}
+
+void http_consumer::run( http_job *job ) {
+  // identical requests in flight don't hold a worker while they wait.
+  if( _server->_coalescer.join( job ) ) {
+    return;
+  }
+  else if( job->route && job->route->bulkhead ) {
+    job->route->bulkhead->submit( job );
+    return;
+  }
+  else if( job->route && job->route->is_async() ) {
+    job->process_async();
+    return;
+  }
+
+  job->process();
+  job->respond();
+  delete job;
+}
+
+http_server::http_server( string address, unsigned short port, unsigned int threads ) :
+   _address(address), _port(port), _threads(threads), _scheduler(threads), _consumer(this), _pending(0), _stopping(false), 
+   _compress(false), _coalescer(&_scheduler), _shedding(false), _prioritized(false), _fair(false), drain_timeout(30)
+{
   _server = new tcp_server( port, address.c_str() );
+
+  _coalescer.on_retry( [this]( http_job *job ) {
+    _consumer.run( job );
+  });
 }
 
 http_server::~http_server() {
   log( INFO, "Stopping http_server ..." );
 
+  // the handler must not reach a dead server.
+  restore_signals();
+
   _server->stop();
   delete _server;
 
-  for( auto i = _consumers.begin(), e = _consumers.end(); i != e; ++i ){
+  _scheduler.stop();
+
+  for( auto i = _bulkheads.begin(), e = _bulkheads.end(); i != e; ++i ){
     delete (*i);
   }
 
-  _consumers.clear();
+  _bulkheads.clear();
+}
 
-  for( auto i = _routes.begin(), e = _routes.end(); i != e; ++i ){
-    delete (*i);
+http_route *http_server::route( string path, http_controller *controller, http_controller::handler_t handler, unsigned int methods /* = ANY */ ) {
+  return route( path, [controller, handler]( http_request& req, http_response& resp ) {
+    (controller->*handler)( req, resp );
+  }, methods );
+}
+
+http_route *http_server::constant( string path, const http_response& response, unsigned int methods /* = GET */ ) {
+  if( response.is_streaming() || response.is_subscription() ) {
+    throw std::invalid_argument( "Streaming responses can't be prebuilt." );
+  }
+
+  http_route   *route = new http_route( path, []( http_request& req, http_response& resp ) {}, methods );
+  http_response identity = response;
+  string        bytes;
+
+  if( _compress && response.headers.find("Content-Encoding") == response.headers.end() ) {
+    string body;
+    response.write_body( body );
+
+    // bodies not worth compressing still get compressed variants, only sent
+    // to clients refusing the plain one.
+    route->prebuilt_preferred = _compression.compressible( response, body.size() );
+
+    ContentEncoding encodings[] = { ENCODING_GZIP, ENCODING_DEFLATE };
+    for( auto encoding : encodings ) {
+      string zipped;
+      if( _compression.compress( encoding, body, zipped ) ) {
+        http_response variant = response;
+
+        variant.headers["Content-Encoding"] = http_compression::name(encoding);
+        http_compression::vary( variant );
+
+        bytes.clear();
+        variant.serialize( bytes, zipped );
+        route->prebuilt[encoding] = http_cache::freeze( std::move(bytes) );
+        // the plain bytes are a variant too.
+        http_compression::vary( identity );
+      }
+    }
+  }
+
+  bytes.clear();
+  identity.serialize( bytes );
+  route->prebuilt[ENCODING_IDENTITY] = http_cache::freeze( std::move(bytes) );
+
+  return add( "", route );
+}
+
+http_route *http_server::add( const string& host, http_route *route ) {
+  log( DEBUG, "Registering handler for path '%s'%s%s", route->path.c_str(), host.empty() ? "" : " on host ", host.c_str() );
+  return _router.add( host, route );
+}
+
+void http_server::compress( bool enabled /* = true */ ) {
+  if( enabled && !http_compression::available() ) {
+    log( WARNING, "librestd was built without zlib, responses won't be compressed." );
   }
+  _compress = enabled;
+}
+
+void http_server::shed_load( unsigned int target_ms /* = 20 */, unsigned int interval_ms /* = 100 */, unsigned int retry_after /* = 1 */ ) {
+  http_response response;
+  string        bytes;
 
-  _routes.clear();
+  response.unavailable( retry_after );
+  response.serialize( bytes );
+
+  _shed_response = http_cache::freeze( std::move(bytes) );
+  _shedder.configure( std::chrono::milliseconds(target_ms), std::chrono::milliseconds(interval_ms) );
+  _shedding = true;
+}
+
+void http_server::prioritize( http_classifier_t classifier /* = http_classifier_t() */ ) {
+  _classifier  = classifier;
+  _prioritized = true;
+}
+
+void http_server::fair_queue( const string& header /* = "" */, std::chrono::microseconds quantum /* = 1ms */ ) {
+  _fair_header = header;
+  _fair        = true;
+  _priorities.quantum( quantum );
 }
 
-void http_server::route( string path, http_controller *controller, http_controller::handler_t handler, unsigned int methods /* = ANY */ ) {
-  log( DEBUG, "Registering controller for path '%s'", path.c_str() );
-  _routes.push_back( new http_route( path, controller, handler, methods ) );
+uint64_t http_server::flow_of( const http_request& req, tcp_stream *client ) {
+  if( !_fair_header.empty() ) {
+    auto i = req.headers.find( _fair_header );
+    if( i != req.headers.end() && !i->second.empty() ) {
+      return strings::hash( i->second );
+    }
+  }
+  return strings::hash( client->peer_address() );
+}
+
+http_bulkhead *http_server::bulkhead( string name, unsigned int max_concurrent, unsigned int max_queued /* = 0 */, unsigned int threads /* = 0 */ ) {
+  log( DEBUG, "Creating bulkhead '%s' ( max_concurrent=%u max_queued=%u threads=%u )", name.c_str(), max_concurrent, max_queued, threads );
+  http_bulkhead *b = new http_bulkhead( name, max_concurrent, max_queued, threads, &_scheduler );
+  _bulkheads.push_back(b);
+  return b;
+}
+
+static std::atomic<http_server *>      signalled_server( NULL );
+// what the signals did before stop_on(), restored with the last server.
+static std::mutex                      signals_mutex;
+static std::map<int, struct sigaction> signals_saved;
+
+static void on_stop_signal( int signo ) {
+  http_server *server = signalled_server.load();
+  if( server ) {
+    server->stop();
+  }
+}
+
+void http_server::pin_acceptor( const affinity::cpu_list_t& cpus ) {
+  _acceptor_cpus = cpus;
+}
+
+void http_server::pin_workers( const affinity::cpu_list_t& cpus ) {
+  _worker_cpus = cpus;
+}
+
+void http_server::stop() {
+  _stopping = true;
+  _server->interrupt();
+}
+
+void http_server::stop_on( int signo /* = SIGTERM */ ) {
+  struct sigaction act, old;
+
+  signalled_server = this;
+
+  sigemptyset(&act.sa_mask);
+  act.sa_flags   = 0;
+  act.sa_handler = on_stop_signal;
+
+  std::lock_guard<std::mutex> lock( signals_mutex );
+
+  if( sigaction( signo, &act, &old ) == 0 && old.sa_handler != on_stop_signal ) {
+    signals_saved[signo] = old;
+  }
+}
+
+void http_server::restore_signals() {
+  http_server *self = this;
+  // another server may have taken the signals over meanwhile.
+  if( signalled_server.compare_exchange_strong( self, NULL ) == false ) {
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock( signals_mutex );
+
+  for( auto i = signals_saved.begin(), e = signals_saved.end(); i != e; ++i ) {
+    sigaction( i->first, &i->second, NULL );
+  }
+  signals_saved.clear();
+}
+
+void http_server::release() {
+  // pairs with drain(): either it sees the count at zero, or we see it's
+  // stopping and wake it up.
+  if( --_pending == 0 && _stopping ) {
+    std::lock_guard<std::mutex> lock(_drain_mutex);
+    _drained.notify_all();
+  }
+}
+
+void http_server::drain() {
+  // new connections are refused from now on.
+  _stopping = true;
+  _server->stop();
+
+  log( INFO, "Draining %u requests ( timeout %us ) ...", _pending.load(), drain_timeout );
+
+  {
+    std::unique_lock<std::mutex> lock(_drain_mutex);
+    _drained.wait_for( lock, std::chrono::seconds( drain_timeout ), [this]() { return _pending == 0; } );
+  }
+
+  // event streams never end by themselves, other servers' ones aren't ours to end.
+  http_sse_channel::close_all( this );
+
+  if( _pending ) {
+    log( WARNING, "%u requests still running after %us, stopping the workers.", _pending.load(), drain_timeout );
+  }
+
+  // either way nothing runs on them once we return, the handlers still
+  // running are waited for and whatever is still queued is answered.
+  for( auto i = _bulkheads.begin(), e = _bulkheads.end(); i != e; ++i ){
+    (*i)->stop();
+  }
+  _scheduler.stop();
+
+  log( INFO, "http_server stopped." );
 }
 
 void http_server::start() {
   log( INFO, "Starting http_server ..." );
 
   if( _server->start() == true ){
-    for( auto i = _consumers.begin(), e = _consumers.end(); i != e; ++i ){
+    for( auto i = _bulkheads.begin(), e = _bulkheads.end(); i != e; ++i ){
       (*i)->start();
     }
 
+    if( !_acceptor_cpus.empty() && affinity::pin( _acceptor_cpus ) ) {
+      log( INFO, "Acceptor pinned to cpus %s.", affinity::format( _acceptor_cpus ).c_str() );
+    }
+
+    if( !_worker_cpus.empty() ) {
+      _scheduler.on_worker_start( [this]( unsigned int index ) {
+        int cpu = _worker_cpus[ index % _worker_cpus.size() ];
+        if( affinity::pin( affinity::cpu_list_t( 1, cpu ) ) ) {
+          log( DEBUG, "Worker %u pinned to cpu %d ( node %d ).", index, cpu, affinity::node_of(cpu) );
+        }
+      });
+    }
+
+    _scheduler.start();
+
     log( INFO, "Server listening on %s:%d with %lu workers ...", _address.c_str(), _port, _threads );
-    while(1) {
-      tcp_stream *client = _server->accept();
-      if( client ){
-        _queue.add(client);
+    tcp_stream *clients[max_accept_batch];
+    task_t      tasks[max_accept_batch];
+
+    while( !_stopping && _server->listening() ) {
+      // a burst of connections is published in one go.
+      size_t n = _server->accept_many( clients, max_accept_batch );
+      _pending += n;
+      for( size_t i = 0; i < n; ++i ) {
+        tcp_stream *client = clients[i];
+        tasks[i] = [this, client]() {
+          _consumer.consume(client);
+        };
       }
+      _scheduler.submit_many( tasks, n );
     }
+
+    drain();
   } else {
     log( CRITICAL, "Could not start http_server." );
   }
@@ -0,0 +1,332 @@
+/*
+ * This file is part of librestd.
+ *
+ * Copyleft of Simone Margaritelli aka evilsocket <evilsocket@protonmail.com>
+ *
+ * librestd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * librestd is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with librestd.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "strings.h"
+#include "http_sse.h"
+#include "coarse_clock.h"
+#include "log.h"
+
+#include <cerrno>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <unordered_map>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+
+namespace restd {
+
+// Every subscriber of every channel lives here, the loop thread only
+// wakes up for disconnections, sockets becoming writable again after a
+// short write and heartbeats.
+class http_sse_loop
+{
+  private:
+
+    static const int max_events = 64;
+
+    typedef struct {
+      tcp_stream       *client;
+      http_sse_channel *channel;
+      const void       *owner;
+      string            pending;
+    }
+    subscriber_t;
+
+    int                                   _epoll;
+    int                                   _wakeup;
+    bool                                  _running;
+    time_t                                _last_beat;
+    std::unordered_map<int, subscriber_t> _subscribers;
+    std::thread                           _thread;
+
+    http_sse_loop();
+    ~http_sse_loop();
+
+    void run();
+    void watch( int fd, bool writable );
+    bool flush( subscriber_t& sub );
+
+  public:
+
+    // guards the subscribers of every channel.
+    std::mutex mutex;
+
+    static http_sse_loop& instance();
+
+    void add( http_sse_channel *channel, tcp_stream *client, const void *owner );
+    // Closes the subscriber, the caller holds mutex.
+    void remove( int fd );
+    void remove_all( const void *owner );
+    // Writes or buffers data, false if the subscriber must be removed.
+    bool write( int fd, std::string_view data );
+};
+
+http_sse_loop::http_sse_loop() : _running(true), _last_beat( coarse_clock::now() ) {
+  _epoll  = epoll_create1( EPOLL_CLOEXEC );
+  _wakeup = eventfd( 0, EFD_CLOEXEC | EFD_NONBLOCK );
+
+  struct epoll_event ev = {};
+  ev.events  = EPOLLIN;
+  ev.data.fd = _wakeup;
+  epoll_ctl( _epoll, EPOLL_CTL_ADD, _wakeup, &ev );
+
+  _thread = std::thread( &http_sse_loop::run, this );
+}
+
+http_sse_loop::~http_sse_loop() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    _running = false;
+  }
+
+  uint64_t one = 1;
+  if( ::write( _wakeup, &one, sizeof(one) ) != sizeof(one) ) {
+    log( ERROR, "Could not wake up the SSE loop: %s", strerror(errno) );
+  }
+  _thread.join();
+
+  for( auto i = _subscribers.begin(), e = _subscribers.end(); i != e; ++i ) {
+    delete i->second.client;
+  }
+
+  close( _wakeup );
+  close( _epoll );
+}
+
+http_sse_loop& http_sse_loop::instance() {
+  static http_sse_loop loop;
+  return loop;
+}
+
+void http_sse_loop::watch( int fd, bool writable ) {
+  struct epoll_event ev = {};
+  ev.events  = EPOLLIN | EPOLLRDHUP | ( writable ? EPOLLOUT : 0 );
+  ev.data.fd = fd;
+  epoll_ctl( _epoll, EPOLL_CTL_MOD, fd, &ev );
+}
+
+void http_sse_loop::add( http_sse_channel *channel, tcp_stream *client, const void *owner ) {
+  int fd = client->descriptor();
+
+  std::lock_guard<std::mutex> lock(mutex);
+
+  _subscribers[fd] = subscriber_t{ client, channel, owner, string() };
+  channel->_subscribers.insert(fd);
+
+  struct epoll_event ev = {};
+  ev.events  = EPOLLIN | EPOLLRDHUP;
+  ev.data.fd = fd;
+  if( epoll_ctl( _epoll, EPOLL_CTL_ADD, fd, &ev ) != 0 ) {
+    log( ERROR, "Could not watch SSE subscriber: %s", strerror(errno) );
+    remove(fd);
+  }
+}
+
+void http_sse_loop::remove( int fd ) {
+  auto i = _subscribers.find(fd);
+  if( i == _subscribers.end() ) {
+    return;
+  }
+
+  log( DEBUG, "%s left channel '%s'.", i->second.client->peer_address().c_str(), i->second.channel->name().c_str() );
+
+  epoll_ctl( _epoll, EPOLL_CTL_DEL, fd, NULL );
+  i->second.channel->_subscribers.erase(fd);
+  delete i->second.client;
+  _subscribers.erase(i);
+}
+
+void http_sse_loop::remove_all( const void *owner ) {
+  std::lock_guard<std::mutex> lock(mutex);
+  std::vector<int>            owned;
+
+  for( auto i = _subscribers.begin(), e = _subscribers.end(); i != e; ++i ) {
+    if( i->second.owner == owner ) {
+      owned.push_back( i->first );
+    }
+  }
+
+  for( auto i = owned.begin(), e = owned.end(); i != e; ++i ) {
+    remove(*i);
+  }
+}
+
+bool http_sse_loop::flush( subscriber_t& sub ) {
+  ssize_t w = ::send( sub.client->descriptor(), sub.pending.data(), sub.pending.size(), MSG_NOSIGNAL | MSG_DONTWAIT );
+  if( w < 0 ) {
+    return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+  }
+
+  sub.pending.erase( 0, w );
+  if( sub.pending.empty() ) {
+    watch( sub.client->descriptor(), false );
+  }
+  return true;
+}
+
+bool http_sse_loop::write( int fd, std::string_view data ) {
+  auto i = _subscribers.find(fd);
+  if( i == _subscribers.end() ) {
+    return true;
+  }
+
+  subscriber_t& sub = i->second;
+
+  // keep the order, the loop will send this after what's pending.
+  if( !sub.pending.empty() ) {
+    if( sub.pending.size() + data.size() > http_sse_channel::max_pending ) {
+      log( WARNING, "%s is too slow for channel '%s', dropping it.", sub.client->peer_address().c_str(), sub.channel->name().c_str() );
+      return false;
+    }
+    sub.pending.append( data.data(), data.size() );
+    return true;
+  }
+
+  ssize_t w = ::send( fd, data.data(), data.size(), MSG_NOSIGNAL | MSG_DONTWAIT );
+  if( w < 0 ) {
+    if( errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR ) {
+      return false;
+    }
+    w = 0;
+  }
+
+  if( (size_t)w < data.size() ) {
+    sub.pending.assign( data.data() + w, data.size() - w );
+    watch( fd, true );
+  }
+  return true;
+}
+
+void http_sse_loop::run() {
+  struct epoll_event events[max_events];
+
+  while( true ) {
+    int n = epoll_wait( _epoll, events, max_events, http_sse_channel::heartbeat * 1000 );
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if( !_running ) {
+      break;
+    }
+
+    std::vector<int> dead;
+
+    for( int i = 0; i < n; ++i ) {
+      int  fd  = events[i].data.fd;
+      auto sub = _subscribers.find(fd);
+      if( fd == _wakeup || sub == _subscribers.end() ) {
+        continue;
+      }
+
+      // subscribers aren't supposed to send anything, data or EOF both
+      // mean they're gone.
+      if( events[i].events & ( EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR ) ) {
+        dead.push_back(fd);
+      }
+      else if( ( events[i].events & EPOLLOUT ) && flush( sub->second ) == false ) {
+        dead.push_back(fd);
+      }
+    }
+
+    time_t now = coarse_clock::now();
+    if( now - _last_beat >= http_sse_channel::heartbeat ) {
+      _last_beat = now;
+      for( auto i = _subscribers.begin(), e = _subscribers.end(); i != e; ++i ) {
+        if( write( i->first, ":\n\n" ) == false ) {
+          dead.push_back( i->first );
+        }
+      }
+    }
+
+    for( auto i = dead.begin(), e = dead.end(); i != e; ++i ) {
+      remove(*i);
+    }
+  }
+}
+
+http_sse_channel::http_sse_channel( string name ) : _name(name) {
+  // make sure the loop is around for as long as we are.
+  http_sse_loop::instance();
+}
+
+http_sse_channel::~http_sse_channel() {
+  http_sse_loop& loop = http_sse_loop::instance();
+  std::lock_guard<std::mutex> lock( loop.mutex );
+
+  while( !_subscribers.empty() ) {
+    loop.remove( *_subscribers.begin() );
+  }
+}
+
+void http_sse_channel::subscribe( tcp_stream *client, const void *owner /* = NULL */ ) {
+  log( DEBUG, "%s joined channel '%s'.", client->peer_address().c_str(), _name.c_str() );
+
+  http_sse_loop::instance().add( this, client, owner );
+}
+
+void http_sse_channel::publish( std::string_view data, std::string_view event /* = "" */, std::string_view id /* = "" */ ) {
+  static thread_local string frame;
+  static thread_local std::vector<int> dead;
+
+  frame.clear();
+  if( !id.empty() ) {
+    frame += "id: ";
+    frame += id;
+    frame += '\n';
+  }
+  if( !event.empty() ) {
+    frame += "event: ";
+    frame += event;
+    frame += '\n';
+  }
+  do {
+    size_t nl = data.find('\n');
+    frame += "data: ";
+    frame += data.substr( 0, nl );
+    frame += '\n';
+    data = nl == std::string_view::npos ? std::string_view() : data.substr( nl + 1 );
+  }
+  while( !data.empty() );
+  frame += '\n';
+
+  http_sse_loop& loop = http_sse_loop::instance();
+  std::lock_guard<std::mutex> lock( loop.mutex );
+
+  dead.clear();
+  for( auto i = _subscribers.begin(), e = _subscribers.end(); i != e; ++i ) {
+    if( loop.write( *i, frame ) == false ) {
+      dead.push_back(*i);
+    }
+  }
+
+  for( auto i = dead.begin(), e = dead.end(); i != e; ++i ) {
+    loop.remove(*i);
+  }
+}
+
+void http_sse_channel::close_all( const void *owner ) {
+  http_sse_loop::instance().remove_all( owner );
+}
+
+size_t http_sse_channel::size() {
+  std::lock_guard<std::mutex> lock( http_sse_loop::instance().mutex );
+  return _subscribers.size();
+}
+
+}
@@ -0,0 +1,122 @@
+/*
+ * This file is part of librestd.
+ *
+ * Copyleft of Simone Margaritelli aka evilsocket <evilsocket@protonmail.com>
+ *
+ * librestd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * librestd is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with librestd.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "http_stream.h"
+#include "log.h"
+
+#include <charconv>
+
+namespace restd {
+
+static const char kLastChunk[] = "0\r\n\r\n";
+
+http_stream_writer::http_stream_writer( tcp_stream *client, ContentEncoding encoding /* = ENCODING_IDENTITY */, int level /* = 6 */ ) :
+  _client(client), _deflater(NULL), _sent(0), _failed(false) {
+  _buffer.reserve( header_size + chunk_size + 2 );
+  _buffer.assign( header_size, ' ' );
+
+  if( encoding != ENCODING_IDENTITY ) {
+    _deflater = new http_deflater( encoding, level );
+    _failed   = !_deflater->ok();
+  }
+}
+
+http_stream_writer::~http_stream_writer() {
+  delete _deflater;
+}
+
+bool http_stream_writer::send( const char *data, size_t size ) {
+  ssize_t sent = _client->send( (const unsigned char *)data, size );
+  if( sent != (ssize_t)size ) {
+    log( ERROR, "Could not send chunk, sent %ld out of %lu bytes.", sent, size );
+    _failed = true;
+  }
+  return !_failed;
+}
+
+bool http_stream_writer::write( const char *data, size_t size ) {
+  if( _deflater && !_failed ) {
+    if( _deflater->write( data, size, _buffer ) == false ) {
+      _failed = true;
+    }
+    else if( _buffer.size() - header_size >= chunk_size ) {
+      send_chunk();
+    }
+    return !_failed;
+  }
+
+  while( size && !_failed ) {
+    size_t room = chunk_size - ( _buffer.size() - header_size ),
+           n    = size < room ? size : room;
+
+    _buffer.append( data, n );
+    data += n;
+    size -= n;
+
+    if( _buffer.size() - header_size == chunk_size ) {
+      send_chunk();
+    }
+  }
+
+  return !_failed;
+}
+
+bool http_stream_writer::flush() {
+  if( _deflater && !_failed && _deflater->flush( _buffer ) == false ) {
+    _failed = true;
+  }
+  return send_chunk();
+}
+
+bool http_stream_writer::send_chunk() {
+  size_t size = _buffer.size() - header_size;
+  if( size == 0 || _failed ) {
+    return !_failed;
+  }
+  // right align "<hex size>\r\n" in the reserved space so the chunk goes
+  // out with a single write.
+  char   hex[16];
+  auto   r   = std::to_chars( hex, hex + sizeof(hex), size, 16 );
+  size_t len = r.ptr - hex,
+         at  = header_size - len - 2;
+
+  _buffer.replace( at, len, hex, len );
+  _buffer[header_size - 2] = '\r';
+  _buffer[header_size - 1] = '\n';
+  _buffer += "\r\n";
+
+  if( send( _buffer.data() + at, _buffer.size() - at ) ) {
+    _sent += size;
+  }
+
+  _buffer.assign( header_size, ' ' );
+  return !_failed;
+}
+
+bool http_stream_writer::finish() {
+  if( _deflater && !_failed && _deflater->finish( _buffer ) == false ) {
+    _failed = true;
+  }
+
+  if( send_chunk() ) {
+    send( kLastChunk, sizeof(kLastChunk) - 1 );
+  }
+  return !_failed;
+}
+
+}
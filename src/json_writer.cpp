@@ -0,0 +1,249 @@
+/*
+ * This file is part of librestd.
+ *
+ * Copyleft of Simone Margaritelli aka evilsocket <evilsocket@protonmail.com>
+ *
+ * librestd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * librestd is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with librestd.  If not, see <http://www.gnu.org/licenses/>.
+*/
+// include our strings.h first, <cstring> would otherwise pick it up
+// instead of the system <strings.h> as we share the include path.
+#include "strings.h"
+#include "json_writer.h"
+
+#include <charconv>
+#include <cmath>
+#include <stdexcept>
+
+namespace restd {
+
+static const char kHex[] = "0123456789abcdef";
+
+json_writer::json_writer( std::string& out ) : _out(out), _depth(0), _has_elements(0), _after_key(false) {
+
+}
+
+bool json_writer::mark() {
+  if( _depth < inline_depth ) {
+    uint64_t bit = 1ULL << _depth;
+    bool     had = _has_elements & bit;
+
+    _has_elements |= bit;
+    return had;
+  }
+
+  bool had = _deep_elements[ _depth - inline_depth ];
+  _deep_elements[ _depth - inline_depth ] = true;
+  return had;
+}
+
+void json_writer::separate() {
+  if( _after_key ) {
+    _after_key = false;
+    return;
+  }
+
+  if( mark() ) {
+    _out += ',';
+  }
+}
+
+void json_writer::open( char c ) {
+  separate();
+  _out += c;
+  ++_depth;
+
+  if( _depth < inline_depth ) {
+    _has_elements &= ~( 1ULL << _depth );
+  } else {
+    _deep_elements.resize( _depth - inline_depth + 1 );
+    _deep_elements[ _depth - inline_depth ] = false;
+  }
+}
+
+void json_writer::close( char c ) {
+  if( _depth == 0 ) {
+    throw std::logic_error( "json_writer: unbalanced close." );
+  }
+  _out += c;
+  --_depth;
+}
+
+void json_writer::string( const char *s, size_t size ) {
+  _out += '"';
+
+  size_t start = 0;
+  for( size_t i = 0; i < size; ++i ) {
+    unsigned char c = (unsigned char)s[i];
+    if( c >= 0x20 && c != '"' && c != '\\' ) {
+      continue;
+    }
+    // flush the run of characters that don't need escaping.
+    _out.append( s + start, i - start );
+    start = i + 1;
+
+    switch( c ) {
+      case '"':  _out += "\\\""; break;
+      case '\\': _out += "\\\\"; break;
+      case '\b': _out += "\\b"; break;
+      case '\f': _out += "\\f"; break;
+      case '\n': _out += "\\n"; break;
+      case '\r': _out += "\\r"; break;
+      case '\t': _out += "\\t"; break;
+      default:
+        _out += "\\u00";
+        _out += kHex[ c >> 4 ];
+        _out += kHex[ c & 0xf ];
+    }
+  }
+
+  _out.append( s + start, size - start );
+  _out += '"';
+}
+
+json_writer& json_writer::begin_object() {
+  open('{');
+  return *this;
+}
+
+json_writer& json_writer::end_object() {
+  close('}');
+  return *this;
+}
+
+json_writer& json_writer::begin_array() {
+  open('[');
+  return *this;
+}
+
+json_writer& json_writer::end_array() {
+  close(']');
+  return *this;
+}
+
+json_writer& json_writer::key( std::string_view k ) {
+  separate();
+  string( k.data(), k.size() );
+  _out += ':';
+  _after_key = true;
+  return *this;
+}
+
+json_writer& json_writer::null() {
+  separate();
+  _out += "null";
+  return *this;
+}
+
+json_writer& json_writer::value( bool b ) {
+  separate();
+  _out += b ? "true" : "false";
+  return *this;
+}
+
+json_writer& json_writer::value( int v ) {
+  return value( (int64_t)v );
+}
+
+json_writer& json_writer::value( unsigned int v ) {
+  return value( (uint64_t)v );
+}
+
+json_writer& json_writer::value( int64_t v ) {
+  char buf[32];
+  auto r = std::to_chars( buf, buf + sizeof(buf), v );
+
+  separate();
+  _out.append( buf, r.ptr - buf );
+  return *this;
+}
+
+json_writer& json_writer::value( uint64_t v ) {
+  char buf[32];
+  auto r = std::to_chars( buf, buf + sizeof(buf), v );
+
+  separate();
+  _out.append( buf, r.ptr - buf );
+  return *this;
+}
+
+json_writer& json_writer::value( double v ) {
+  // JSON has no representation for these.
+  if( !std::isfinite(v) ) {
+    return null();
+  }
+
+  char buf[64];
+  auto r = std::to_chars( buf, buf + sizeof(buf), v );
+
+  separate();
+  _out.append( buf, r.ptr - buf );
+  return *this;
+}
+
+json_writer& json_writer::value( const char *s ) {
+  return value( std::string_view(s) );
+}
+
+json_writer& json_writer::value( const std::string& s ) {
+  return value( std::string_view(s) );
+}
+
+json_writer& json_writer::value( std::string_view s ) {
+  separate();
+  string( s.data(), s.size() );
+  return *this;
+}
+
+json_writer& json_writer::value( const nlohmann::json& j ) {
+  switch( j.type() ) {
+    case nlohmann::json::value_t::object: {
+      begin_object();
+      const auto *object = j.get_ptr<const nlohmann::json::object_t *>();
+      for( auto i = object->begin(), e = object->end(); i != e; ++i ) {
+        key( i->first );
+        value( i->second );
+      }
+      return end_object();
+    }
+
+    case nlohmann::json::value_t::array: {
+      begin_array();
+      const auto *array = j.get_ptr<const nlohmann::json::array_t *>();
+      for( auto i = array->begin(), e = array->end(); i != e; ++i ) {
+        value( *i );
+      }
+      return end_array();
+    }
+
+    case nlohmann::json::value_t::string:
+      return value( std::string_view( *j.get_ptr<const nlohmann::json::string_t *>() ) );
+
+    case nlohmann::json::value_t::boolean:
+      return value( j.get<bool>() );
+
+    case nlohmann::json::value_t::number_integer:
+      return value( j.get<int64_t>() );
+
+    case nlohmann::json::value_t::number_unsigned:
+      return value( j.get<uint64_t>() );
+
+    case nlohmann::json::value_t::number_float:
+      return value( j.get<double>() );
+
+    default:
+      return null();
+  }
+}
+
+}
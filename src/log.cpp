@@ -17,25 +17,18 @@
  * along with librestd.  If not, see <http://www.gnu.org/licenses/>.
 */
 #include "log.h"
+#include "coarse_clock.h"
 
 #include <assert.h>
 #include <stdio.h>
 #include <stdarg.h>
-#include <time.h>
 #include <stdlib.h>
 #include <ctype.h>
-#include <string>
-#include <mutex>
-
-using std::string;
-using std::mutex;
 
 namespace restd {
 
 static log_level_t __level      = INFO;
 static FILE       *__fp         = stdout;
-static string      __dateformat = "%m/%d/%Y %X";
-static mutex       __mutex;
 
 void set_log_level( log_level_t level ) {
   __level = level;
@@ -46,29 +39,23 @@ void set_log_fp( FILE *fp ) {
 }
 
 void set_log_dateformat( const char *format ) {
-  __dateformat = format;
+  coarse_clock::set_log_format( format );
 }
 
 void log( log_level_t level, const char *format, ... ) {
-  char 	buffer[4096] 	= {0},
-        timestamp[0xFF] = {0};
-  string slevel = "???";
+  char 	buffer[4096] 	= {0};
+  const char *slevel = "???";
   va_list ap;
-  time_t 		rawtime  = 0;
-  struct tm * timeinfo = NULL;
   char nl = '\n';
 
   if( level >= __level ) {
-    std::unique_lock<std::mutex> lock(__mutex);
-
     va_start( ap, format );
     vsnprintf( buffer, 4096, format, ap );
     va_end(ap);
 
-    time( &rawtime );
-    timeinfo = localtime( &rawtime );
-
-    strftime( timestamp, 0xFF, __dateformat.c_str(), timeinfo );
+    // the timestamp is formatted once per second by the clock thread.
+    char   timestamp[coarse_clock::stamp_size];
+    size_t timestamp_len = coarse_clock::log_timestamp( timestamp );
 
     switch( level ){
       case DEBUG    : slevel = "DBG"; break;
@@ -78,10 +65,11 @@ void log( log_level_t level, const char *format, ... ) {
       case CRITICAL : slevel = "CRT"; break;
     }
 
-    if( string(buffer).find('\n') != string::npos )
+    if( std::string_view( buffer ).find('\n') != std::string_view::npos )
       nl = 0x00;
 
-    fprintf( __fp, "[%s] [%s] %s%c", timestamp, slevel.c_str(), buffer, nl );
+    // a single fprintf call is atomic on the stream, no need for a lock.
+    fprintf( __fp, "[%.*s] [%s] %s%c", (int)timestamp_len, timestamp, slevel, buffer, nl );
   }
 }
 
@@ -0,0 +1,403 @@
+/*
+ * This file is part of librestd.
+ *
+ * Copyleft of Simone Margaritelli aka evilsocket <evilsocket@protonmail.com>
+ *
+ * librestd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * librestd is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with librestd.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "scheduler.h"
+
+namespace restd {
+
+static thread_local scheduler *t_scheduler = NULL;
+static thread_local void      *t_worker    = NULL;
+// set while the thread runs queued tasks from latch::wait().
+static thread_local bool       t_helping   = false;
+
+scheduler::scheduler( unsigned int threads ) : _workers( threads, NULL ), _ready(0), _next(0), _sleepers(0), _blocked(0), _running(false) {
+
+}
+
+scheduler::~scheduler() {
+  stop();
+
+  for( auto i = _workers.begin(), e = _workers.end(); i != e; ++i ) {
+    delete *i;
+  }
+  _workers.clear();
+}
+
+void scheduler::start() {
+  std::unique_lock<std::mutex> lock(_mutex);
+
+  _running = true;
+  _ready   = 0;
+
+  for( unsigned int i = 0; i < _workers.size(); ++i ) {
+    _threads.push_back( std::thread( &scheduler::run, this, i ) );
+  }
+
+  _wakeup.wait( lock, [this]() { return _ready == _workers.size(); } );
+}
+
+void scheduler::stop() {
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _running = false;
+  }
+  _wakeup.notify_all();
+
+  for( auto i = _threads.begin(), e = _threads.end(); i != e; ++i ) {
+    if( i->joinable() ) {
+      i->join();
+    }
+  }
+  _threads.clear();
+}
+
+void scheduler::push( worker_t *worker, task_t&& task, std::deque<task_t> worker_t::*queue ) {
+  {
+    std::lock_guard<std::mutex> lock( worker->mutex );
+    (worker->*queue).push_back( std::move(task) );
+  }
+
+  notify(1);
+}
+
+void scheduler::notify( size_t n ) {
+  // pairs with the sleepers increment in run(): either we see the
+  // sleeper, or it sees the task when checking again before waiting.
+  std::atomic_thread_fence( std::memory_order_seq_cst );
+  if( _sleepers.load( std::memory_order_relaxed ) ) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if( n == 1 ) {
+      _wakeup.notify_one();
+    } else {
+      _wakeup.notify_all();
+    }
+  }
+}
+
+void scheduler::submit( task_t task ) {
+  if( t_scheduler == this ) {
+    push( (worker_t *)t_worker, std::move(task), &worker_t::inbox );
+  } else {
+    push( _workers[ _next.fetch_add( 1, std::memory_order_relaxed ) % _workers.size() ], std::move(task), &worker_t::inbox );
+  }
+}
+
+void scheduler::defer( task_t task ) {
+  if( t_scheduler == this ) {
+    push( (worker_t *)t_worker, std::move(task), &worker_t::deferred );
+  } else {
+    push( _workers[ _next.fetch_add( 1, std::memory_order_relaxed ) % _workers.size() ], std::move(task), &worker_t::deferred );
+  }
+}
+
+void scheduler::submit_many( task_t *tasks, size_t n ) {
+  size_t workers = _workers.size(),
+         first   = _next.fetch_add( n, std::memory_order_relaxed );
+
+  // task i goes to worker ( first + i ) % workers, as if submitted one by one.
+  for( size_t w = 0; w < workers && w < n; ++w ) {
+    worker_t *worker = _workers[ ( first + w ) % workers ];
+    std::lock_guard<std::mutex> lock( worker->mutex );
+
+    for( size_t i = w; i < n; i += workers ) {
+      worker->inbox.push_back( std::move(tasks[i]) );
+    }
+  }
+
+  notify(n);
+}
+
+bool scheduler::pop( worker_t *self, task_t& task ) {
+  std::lock_guard<std::mutex> lock( self->mutex );
+
+  if( !self->spawned.empty() ) {
+    task = std::move( self->spawned.back() );
+    self->spawned.pop_back();
+    return true;
+  }
+  else if( !self->inbox.empty() ) {
+    task = std::move( self->inbox.front() );
+    self->inbox.pop_front();
+    return true;
+  }
+  else if( !self->deferred.empty() ) {
+    task = std::move( self->deferred.front() );
+    self->deferred.pop_front();
+    return true;
+  }
+
+  return false;
+}
+
+bool scheduler::steal( worker_t *self, task_t& task ) {
+  size_t n     = _workers.size(),
+         start = 0;
+
+  for( size_t i = 0; i < n; ++i ) {
+    if( _workers[i] == self ) {
+      start = i;
+      break;
+    }
+  }
+
+  for( size_t i = 1; i < n; ++i ) {
+    worker_t *victim = _workers[ ( start + i ) % n ];
+    std::lock_guard<std::mutex> lock( victim->mutex );
+
+    if( !victim->spawned.empty() ) {
+      task = std::move( victim->spawned.front() );
+      victim->spawned.pop_front();
+      return true;
+    }
+    else if( !victim->inbox.empty() ) {
+      task = std::move( victim->inbox.front() );
+      victim->inbox.pop_front();
+      return true;
+    }
+    else if( !victim->deferred.empty() ) {
+      task = std::move( victim->deferred.front() );
+      victim->deferred.pop_front();
+      return true;
+    }
+  }
+
+  return false;
+}
+
+void scheduler::run( unsigned int index ) {
+  task_t task;
+
+  if( _init ) {
+    _init( index );
+  }
+
+  worker_t *self = new worker_t();
+
+  // nobody can steal until every worker is there.
+  {
+    std::unique_lock<std::mutex> lock(_mutex);
+    _workers[index] = self;
+    if( ++_ready == _workers.size() ) {
+      _wakeup.notify_all();
+    }
+    _wakeup.wait( lock, [this]() { return _ready == _workers.size(); } );
+  }
+
+  t_scheduler = this;
+  t_worker    = self;
+
+  while( true ) {
+    if( pop( self, task ) || steal( self, task ) ) {
+      task();
+      task = nullptr;
+      continue;
+    }
+
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    _sleepers.fetch_add(1);
+    bool found = pop( self, task ) || steal( self, task );
+    if( !found && _running ) {
+      _wakeup.wait( lock );
+    }
+    _sleepers.fetch_sub(1);
+
+    if( found ) {
+      lock.unlock();
+      task();
+      task = nullptr;
+    }
+    else if( !_running ) {
+      break;
+    }
+  }
+
+  t_scheduler = NULL;
+  t_worker    = NULL;
+}
+
+scheduler *scheduler::current() {
+  return t_scheduler;
+}
+
+bool scheduler::spawn_local( task_t& task ) {
+  if( !t_scheduler ) {
+    return false;
+  }
+
+  t_scheduler->push( (worker_t *)t_worker, std::move(task), &worker_t::spawned );
+  return true;
+}
+
+bool scheduler::run_one() {
+  if( !t_scheduler ) {
+    return false;
+  }
+
+  worker_t *self = (worker_t *)t_worker;
+  task_t    task;
+
+  if( t_scheduler->pop( self, task ) || t_scheduler->steal( self, task ) ) {
+    task();
+    return true;
+  }
+
+  return false;
+}
+
+void scheduler::help( const latch& done ) {
+  worker_t *self = (worker_t *)t_worker;
+  task_t    task;
+
+  while( !done.is_set() ) {
+    if( pop( self, task ) || steal( self, task ) ) {
+      task();
+      task = nullptr;
+      continue;
+    }
+
+    // same as run(), but the latch can wake us up too.
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    _sleepers.fetch_add(1);
+    bool found = !done.is_set() && ( pop( self, task ) || steal( self, task ) );
+    if( !found && !done.is_set() ) {
+      _wakeup.wait( lock );
+    }
+    _sleepers.fetch_sub(1);
+
+    if( found ) {
+      lock.unlock();
+      task();
+      task = nullptr;
+    }
+  }
+}
+
+void latch::set() {
+  scheduler *pool;
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _set.store( true );
+    _cond.notify_all();
+    pool = _pool.load();
+  }
+  // the waiter might sleep with the idle workers, wake them all.
+  if( pool ) {
+    pool->notify( pool->size() + 1 );
+  }
+}
+
+void latch::wait() {
+  for( unsigned i = 0; i < spin_count && !_set.load(); ++i ) {
+    std::this_thread::yield();
+  }
+
+  if( !_set.load() ) {
+    scheduler *pool = scheduler::current();
+
+    // tasks run by a helper share its stack and its thread locals with the
+    // request it's helping, so they don't help in turn: helpers don't nest.
+    if( pool && pool->_blocked.fetch_add(1) + 1 >= pool->size() && !t_helping ) {
+      _pool.store( pool );
+
+      t_helping = true;
+      pool->help( *this );
+      t_helping = false;
+    }
+    else {
+      std::unique_lock<std::mutex> lock(_mutex);
+      _cond.wait( lock, [this]() { return _set.load(); } );
+    }
+
+    if( pool ) {
+      pool->_blocked.fetch_sub(1);
+    }
+  }
+
+  // set() might not be done with the mutex yet.
+  std::lock_guard<std::mutex> lock(_mutex);
+}
+
+void spawn( task_t task ) {
+  if( scheduler::spawn_local( task ) == false ) {
+    task();
+  }
+}
+
+task_group::task_group() : _state( std::make_shared<state_t>() ) {
+  _state->pending = 0;
+}
+
+bool task_group::run_next( state_t& state ) {
+  task_t task;
+  {
+    std::lock_guard<std::mutex> lock( state.mutex );
+    if( state.tasks.empty() ) {
+      return false;
+    }
+    task = std::move( state.tasks.front() );
+    state.tasks.pop_front();
+  }
+
+  task();
+
+  std::shared_ptr<latch> waiter;
+  {
+    std::lock_guard<std::mutex> lock( state.mutex );
+    if( --state.pending == 0 ) {
+      waiter.swap( state.waiter );
+    }
+  }
+
+  if( waiter ) {
+    waiter->set();
+  }
+  return true;
+}
+
+void task_group::run( task_t task ) {
+  {
+    std::lock_guard<std::mutex> lock( _state->mutex );
+    _state->tasks.push_back( std::move(task) );
+    _state->pending++;
+  }
+
+  std::shared_ptr<state_t> state = _state;
+  spawn( [state]() {
+    run_next( *state );
+  });
+}
+
+void task_group::wait() {
+  while( run_next( *_state ) ) {}
+
+  // the rest is running on other workers.
+  std::shared_ptr<latch> done = std::make_shared<latch>();
+  {
+    std::lock_guard<std::mutex> lock( _state->mutex );
+    if( _state->pending == 0 ) {
+      return;
+    }
+    _state->waiter = done;
+  }
+
+  done->wait();
+}
+
+}
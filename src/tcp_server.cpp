@@ -28,10 +28,18 @@
 
 #include <sys/un.h>
 #include <sys/stat.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <algorithm>
 
 namespace restd {
 
-tcp_server::tcp_server(int port, const char* address) : _lsd(0), _port(port), _address(address), _listening(false), _is_unix(false), _domain(AF_INET) {
+// milliseconds between accepts while out of descriptors.
+static const int min_accept_backoff = 10;
+static const int max_accept_backoff = 1000;
+
+tcp_server::tcp_server(int port, const char* address) : _lsd(0), _port(port), _address(address), _listening(false), _is_unix(false), _domain(AF_INET), _wakeup(-1) {
   _is_unix = address[0] == '/';
   _domain  = _is_unix ? AF_LOCAL : AF_INET;
 } 
@@ -41,6 +49,9 @@ tcp_server::~tcp_server() {
   if(_lsd > 0) {
     close(_lsd);
   }
+  if(_wakeup >= 0) {
+    close(_wakeup);
+  }
 }
 
 bool tcp_server::start() {
@@ -112,7 +123,13 @@ bool tcp_server::start() {
     return false;
   }
 
-  result = listen(_lsd, 5);
+  // accept() waits with poll(), so bursts can be drained without blocking.
+  if( fcntl( _lsd, F_SETFL, fcntl( _lsd, F_GETFL, 0 ) | O_NONBLOCK ) != 0 ) {
+    log( ERROR, "tcp_server: fcntl( O_NONBLOCK ) failed: %s", strerror(errno) );
+    return false;
+  }
+
+  result = listen(_lsd, SOMAXCONN);
   if(result != 0) {
     log( ERROR, "tcp_server: listen failed: %s", strerror(errno) );
     return false;
@@ -125,6 +142,12 @@ bool tcp_server::start() {
     }
   }
 
+  _wakeup = eventfd( 0, EFD_CLOEXEC | EFD_NONBLOCK );
+  if( _wakeup < 0 ) {
+    log( ERROR, "tcp_server: eventfd failed: %s", strerror(errno) );
+    return false;
+  }
+
   _listening = true;
   return true;
 }
@@ -135,20 +158,97 @@ tcp_stream *tcp_server::accept() {
     return NULL;
   }
 
-  struct sockaddr_in address;
-  socklen_t len = sizeof(address);
-  memset(&address, 0, sizeof(address));
-  int sd = ::accept(_lsd, (struct sockaddr*)&address, &len);
-  if (sd < 0) {
-    log( ERROR, "tcp_server::accept failed: %s", strerror(errno) );
-    return NULL;
+  tcp_stream *client = NULL;
+  accept_many( &client, 1 );
+  return client;
+}
+
+size_t tcp_server::accept_many( tcp_stream **clients, size_t max ) {
+  if (_listening == false) {
+    log( ERROR, "Called tcp_server::accept_many before tcp_server::start!" );
+    return 0;
+  }
+
+  size_t n       = 0;
+  int    backoff = min_accept_backoff;
+
+  while( n < max ) {
+    struct sockaddr_in address;
+    socklen_t len = sizeof(address);
+    memset(&address, 0, sizeof(address));
+
+    // accepted sockets are blocking, whatever the listening one is.
+    int sd = ::accept4(_lsd, (struct sockaddr*)&address, &len, SOCK_CLOEXEC);
+    if( sd >= 0 ) {
+      clients[n++] = new tcp_stream(sd, &address);
+      continue;
+    }
+    // a connection reset before we got to it, the next one is fine.
+    else if( errno == EINTR || errno == ECONNABORTED ) {
+      continue;
+    }
+    // the listener is gone, accepting again won't ever succeed.
+    else if( errno == EBADF || errno == EINVAL || errno == ENOTSOCK ) {
+      log( ERROR, "tcp_server::accept failed: %s, not listening anymore.", strerror(errno) );
+      _listening = false;
+      break;
+    }
+    else if( errno != EAGAIN && errno != EWOULDBLOCK ) {
+      // out of descriptors or memory, the connection stays in the backlog and
+      // the listener readable: polling it again, or retrying whatever else
+      // went wrong, would just spin, so only the wakeup is watched for a while.
+      if( n ) {
+        break;
+      }
+      else if( backoff == min_accept_backoff ) {
+        log( WARNING, "tcp_server::accept failed: %s, backing off.", strerror(errno) );
+      }
+
+      struct pollfd pfd = { _wakeup, POLLIN, 0 };
+      if( poll( &pfd, 1, backoff ) > 0 ) {
+        break;
+      }
+
+      backoff = std::min( backoff * 2, max_accept_backoff );
+      continue;
+    }
+    // backlog drained, return what we have or wait for the next one.
+    else if( n ) {
+      break;
+    }
+
+    struct pollfd pfd[2] = { { _lsd, POLLIN, 0 }, { _wakeup, POLLIN, 0 } };
+    if( poll( pfd, 2, -1 ) < 0 && errno != EINTR ) {
+      log( ERROR, "tcp_server::accept poll failed: %s", strerror(errno) );
+
+      // same as a failed accept, don't spin on it.
+      struct pollfd wakeup = { _wakeup, POLLIN, 0 };
+      if( poll( &wakeup, 1, backoff ) > 0 ) {
+        break;
+      }
+      backoff = std::min( backoff * 2, max_accept_backoff );
+    }
+    else if( pfd[1].revents & POLLIN ) {
+      break;
+    }
   }
-  return new tcp_stream(sd, &address);
+
+  return n;
 }
 
 void tcp_server::stop() {
-  close(_lsd);
+  if(_lsd >= 0) {
+    close(_lsd);
+  }
   _lsd = -1;
+  _listening = false;
+}
+
+void tcp_server::interrupt() {
+  uint64_t one = 1;
+  if( _wakeup >= 0 && write( _wakeup, &one, sizeof(one) ) < 0 ) {
+    // nothing we can do from a signal handler.
+  }
 }
 
 }
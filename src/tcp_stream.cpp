@@ -18,13 +18,14 @@
 */
 #include "tcp_stream.h"
 
+#include <cerrno>
 #include <arpa/inet.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 
 namespace restd {
 
-tcp_stream::tcp_stream(int sd, struct sockaddr_in* address) : _sd(sd) {
+tcp_stream::tcp_stream(int sd, struct sockaddr_in* address) : _sd(sd), _accepted_at( std::chrono::steady_clock::now() ) {
   char ip[50] = {0};
 
   inet_ntop(PF_INET, (struct in_addr*)&(address->sin_addr.s_addr), ip, sizeof(ip)-1);
@@ -37,8 +38,63 @@ tcp_stream::~tcp_stream() {
   close(_sd);
 }
 
+void tcp_stream::discard() {
+  unsigned char sink[4096];
+
+  shutdown(_sd, SHUT_WR);
+  while( recv(_sd, sink, sizeof(sink), MSG_DONTWAIT) > 0 ) {
+
+  }
+}
+
 ssize_t tcp_stream::send(const unsigned char* buffer, size_t len) {
-  return write(_sd, buffer, len);
+  size_t sent = 0;
+  // blocking writes, loop on partial writes until everything is out.
+  while( sent < len ) {
+    ssize_t w = write(_sd, buffer + sent, len - sent);
+    if( w < 0 ) {
+      if( errno == EINTR ) {
+        continue;
+      }
+      return sent ? sent : w;
+    }
+    sent += w;
+  }
+  return sent;
+}
+
+ssize_t tcp_stream::send(const struct iovec* iov, int count) {
+  static const int max_parts = 16;
+  struct iovec     parts[max_parts];
+  size_t           sent = 0;
+
+  if( count > max_parts ) {
+    return TCP_ERROR;
+  }
+
+  for( int i = 0; i < count; ++i ) {
+    parts[i] = iov[i];
+  }
+
+  for( int first = 0; first < count; ) {
+    ssize_t w = writev(_sd, parts + first, count - first);
+    if( w < 0 ) {
+      if( errno == EINTR ) {
+        continue;
+      }
+      return sent ? sent : w;
+    }
+    sent += w;
+    // skip what's been written, partially written buffers are resumed.
+    while( first < count && (size_t)w >= parts[first].iov_len ) {
+      w -= parts[first++].iov_len;
+    }
+    if( first < count ) {
+      parts[first].iov_base = (char *)parts[first].iov_base + w;
+      parts[first].iov_len -= w;
+    }
+  }
+  return sent;
 }
 
 ssize_t tcp_stream::receive(unsigned char* buffer, size_t len, int timeout) {